@@ -0,0 +1,180 @@
+#include "batch_queries.hpp"
+#include "term_dict.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <unordered_map>
+
+namespace {
+// Consecutive queries a worker claims at once; neighbours share terms
+constexpr size_t kChunk = 16;
+constexpr size_t kPairCacheBytes = 256 << 20;
+
+struct Batch {
+    std::vector<std::string> texts;
+    std::vector<QueryNode> roots;               // one per distinct normalized query
+    std::vector<std::vector<std::string>> terms;  // distinct terms of each root
+    std::vector<size_t> owner;                  // per input query: index into roots
+};
+
+void collect_terms(const QueryNode &node, std::vector<std::string> &terms) {
+    if (node.kind == QueryNode::Term || node.kind == QueryNode::Pattern) terms.push_back(node.term);
+    terms.insert(terms.end(), node.terms.begin(), node.terms.end());
+    for (const auto &child : node.children) collect_terms(child, terms);
+}
+
+bool load_batch(const std::string &path, Batch &batch) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Cannot open queries file: " << path << "\n";
+        return false;
+    }
+    std::unordered_map<std::string, size_t> seen;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty()) continue;
+        QueryNode root = simplify_query(parse_query(line));
+        auto ins = seen.emplace(query_to_string(root), batch.roots.size());
+        if (ins.second) {
+            std::vector<std::string> terms;
+            collect_terms(root, terms);
+            std::sort(terms.begin(), terms.end());
+            terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+            batch.roots.push_back(std::move(root));
+            batch.terms.push_back(std::move(terms));
+        }
+        batch.owner.push_back(ins.first->second);
+        batch.texts.push_back(std::move(line));
+    }
+    return true;
+}
+
+// Evaluation order: by the query's terms ranked by how many queries share them,
+// so queries on the same head terms run back to back
+std::vector<size_t> group_by_terms(const Batch &batch) {
+    std::unordered_map<std::string, uint32_t> shared;
+    for (const auto &terms : batch.terms) {
+        for (const auto &term : terms) ++shared[term];
+    }
+    std::vector<std::pair<uint32_t, std::string>> by_count;
+    by_count.reserve(shared.size());
+    for (const auto &entry : shared) by_count.emplace_back(entry.second, entry.first);
+    std::sort(by_count.begin(), by_count.end(), [](const auto &a, const auto &b) {
+        return a.first != b.first ? a.first > b.first : a.second < b.second;
+    });
+    std::unordered_map<std::string, uint32_t> rank;
+    for (uint32_t r = 0; r < by_count.size(); ++r) rank[by_count[r].second] = r;
+
+    std::vector<std::vector<uint32_t>> keys(batch.roots.size());
+    for (size_t q = 0; q < keys.size(); ++q) {
+        for (const auto &term : batch.terms[q]) keys[q].push_back(rank[term]);
+        std::sort(keys[q].begin(), keys[q].end());
+    }
+    std::vector<size_t> order(batch.roots.size());
+    for (size_t q = 0; q < order.size(); ++q) order[q] = q;
+    std::stable_sort(order.begin(), order.end(), [&keys](size_t a, size_t b) { return keys[a] < keys[b]; });
+    return order;
+}
+
+bool evaluate_and_write(const Batch &batch, const BatchOptions &options, const TreeSearch &search) {
+    std::vector<size_t> order = group_by_terms(batch);
+    std::vector<std::vector<SearchHit>> results(batch.roots.size());
+    std::vector<uint64_t> took_us(batch.roots.size());
+
+    auto start = std::chrono::steady_clock::now();
+    std::atomic<size_t> next{0};
+    auto work = [&]() {
+        while (true) {
+            size_t begin = next.fetch_add(kChunk);
+            if (begin >= order.size()) return;
+            for (size_t i = begin; i < std::min(order.size(), begin + kChunk); ++i) {
+                size_t q = order[i];
+                auto t0 = std::chrono::steady_clock::now();
+                results[q] = search(batch.roots[q], options.k);
+                auto t1 = std::chrono::steady_clock::now();
+                took_us[q] = std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count();
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < std::max<size_t>(options.threads, 1); ++t) workers.emplace_back(work);
+    work();
+    for (auto &w : workers) w.join();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::ofstream out(options.output_path);
+    if (!out) {
+        std::cerr << "Cannot write batch results: " << options.output_path << "\n";
+        return false;
+    }
+    out << "query_id\tquery\ttook_us\tcount\thits\n";
+    for (size_t i = 0; i < batch.texts.size(); ++i) {
+        std::string text = batch.texts[i];
+        std::replace(text.begin(), text.end(), '\t', ' ');
+        size_t q = batch.owner[i];
+        out << (i + 1) << "\t" << text << "\t" << took_us[q] << "\t" << results[q].size() << "\t";
+        for (size_t h = 0; h < results[q].size(); ++h) {
+            if (h) out << ' ';
+            out << results[q][h].doc_id << ':' << results[q][h].score;
+        }
+        out << "\n";
+    }
+
+    std::vector<uint64_t> sorted = took_us;
+    std::sort(sorted.begin(), sorted.end());
+    auto pct = [&sorted](double p) { return sorted.empty() ? 0 : sorted[static_cast<size_t>(p * (sorted.size() - 1))]; };
+    std::cout << "\n[BATCH]\n";
+    std::cout << "  Queries:   " << batch.texts.size() << " (" << batch.roots.size() << " distinct)\n";
+    std::cout << "  Wall time: " << elapsed << " s, " << (elapsed > 0 ? batch.texts.size() / elapsed : 0.0)
+              << " queries/s on " << std::max<size_t>(options.threads, 1) << " threads\n";
+    std::cout << "  Latency:   p50 " << pct(0.5) << " us, p99 " << pct(0.99) << " us, max " << pct(1.0) << " us\n";
+    std::cout << "  Results:   " << options.output_path << std::endl;
+    return static_cast<bool>(out);
+}
+}
+
+bool run_batch_queries(const BatchOptions &options, const TreeSearch &search) {
+    Batch batch;
+    if (!load_batch(options.queries_path, batch)) return false;
+    return evaluate_and_write(batch, options, search);
+}
+
+bool run_batch_queries(const BatchOptions &options, const PostingLookup &lookup, const Scorer &scorer,
+                       const PatternLookup &patterns) {
+    Batch batch;
+    if (!load_batch(options.queries_path, batch)) return false;
+
+    // Resolve every term and expand every pattern once up front; the workers
+    // only read these tables
+    std::unordered_map<std::string, PostingListView> lists;
+    std::unordered_map<std::string, std::shared_ptr<const PostingList>> expanded;
+    for (const auto &terms : batch.terms) {
+        for (const auto &term : terms) {
+            if (is_term_pattern(term)) {
+                auto ins = expanded.emplace(term, nullptr);
+                if (ins.second && patterns) ins.first->second = patterns(term);
+                continue;
+            }
+            auto ins = lists.emplace(term, PostingListView{});
+            if (ins.second) ins.first->second = lookup(term);
+        }
+    }
+    PostingLookup resolved = [&lists](const std::string &term) {
+        auto it = lists.find(term);
+        return it == lists.end() ? PostingListView{} : it->second;
+    };
+    PatternLookup resolved_patterns = [&expanded](const std::string &pattern) {
+        auto it = expanded.find(pattern);
+        return it == expanded.end() ? nullptr : it->second;
+    };
+    PairCache pairs(kPairCacheBytes);
+    DocSetCache doc_sets(kPairCacheBytes);
+    return evaluate_and_write(batch, options, [&](const QueryNode &root, size_t k) {
+        return run_query_tree(root, resolved, k, nullptr, &scorer, &pairs, resolved_patterns, &doc_sets);
+    });
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "query.hpp"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+struct BatchOptions {
+    std::string queries_path;  // one query per line; empty lines are skipped
+    std::string output_path;   // TSV: query_id, query, took_us, count, hits as doc:score
+    size_t k{10};
+    size_t threads{1};
+};
+
+using TreeSearch = std::function<std::vector<SearchHit>(const QueryNode &root, size_t k)>;
+
+// Parses every query up front and evaluates each distinct normalized query once,
+// spread over `threads` workers. Queries are ordered by their most frequent
+// terms, so consecutive work items touch the same posting lists.
+bool run_batch_queries(const BatchOptions &options, const TreeSearch &search);
+
+// Single posting source: every distinct term is looked up (and every pattern
+// expanded) once for the whole batch, and term-pair intersections and dense
+// terms' DocSets are shared between queries
+bool run_batch_queries(const BatchOptions &options, const PostingLookup &lookup, const Scorer &scorer,
+                       const PatternLookup &patterns = {});
@@ -0,0 +1,489 @@
+// Offline benchmark: generates a deterministic synthetic Russian/HTML corpus and
+// measures loader, tokenizer, stemmer, indexing and search performance.
+// Build next to the main binary (bench.cpp has its own main):
+//   g++ -std=c++17 -O2 -pthread bench.cpp $(ls *.cpp | grep -v -e '^main.cpp$' -e '^bench.cpp$') -o bench
+// Same flags and seed give the same corpus and query mixes, so results of two
+// builds are comparable. Every metric is also written to --out as TSV.
+// The *_mismatches metrics check the document store round trip, and DocSet
+// operations and the dense-term planner against brute force; the exit status is 1 when any of them is non-zero.
+#include "doc_set.hpp"
+#include "doc_store.hpp"
+#include "index.hpp"
+#include "loader.hpp"
+#include "stemmer.hpp"
+#include "tokenizer.hpp"
+#include "zipf.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <unordered_set>
+#include <unistd.h>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+double seconds_since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+struct Options {
+    size_t docs{20000};
+    size_t words{250};  // average words per document
+    size_t vocab{40000};
+    double zipf_s{1.0};
+    size_t queries{2000};  // per query mix
+    uint64_t seed{42};
+    std::string dir{"bench_data"};
+    std::string out{"bench_results.tsv"};
+};
+
+class Report {
+public:
+    explicit Report(const std::string &path) : out_(path) {
+        if (!out_) std::cerr << "Cannot write benchmark results: " << path << "\n";
+        out_ << "metric\tvalue\tunit\n";
+    }
+    void add(const std::string &metric, double value, const std::string &unit) {
+        std::cout << "  " << metric << ": " << value << " " << unit << "\n";
+        out_ << metric << '\t' << value << '\t' << unit << '\n';
+    }
+
+private:
+    std::ofstream out_;
+};
+
+// std distributions differ between standard libraries; this stays reproducible
+double uniform(std::mt19937_64 &rng) {
+    return static_cast<double>(rng() >> 11) * 0x1.0p-53;
+}
+
+// Ranks drawn with P(r) ~ 1 / r^s, the model build_zipf_rows checks against (s = 1)
+class ZipfSampler {
+public:
+    ZipfSampler(size_t n, double s) : cumulative_(n) {
+        double sum = 0;
+        for (size_t r = 0; r < n; ++r) {
+            sum += 1.0 / std::pow(static_cast<double>(r + 1), s);
+            cumulative_[r] = sum;
+        }
+    }
+    size_t operator()(std::mt19937_64 &rng) const {
+        double x = uniform(rng) * cumulative_.back();
+        return static_cast<size_t>(std::lower_bound(cumulative_.begin(), cumulative_.end(), x) - cumulative_.begin());
+    }
+
+private:
+    std::vector<double> cumulative_;
+};
+
+const char *const kConsonants[] = {"б", "в", "г", "д", "ж", "з", "к", "л", "м", "н", "п", "р", "с", "т", "ф", "х", "ч", "ш"};
+const char *const kVowels[] = {"а", "е", "и", "о", "у", "ы", "я", "ю"};
+const char *const kEndings[] = {"", "а", "ы", "ов", "ами", "ого", "ому", "ая", "ие", "ость", "ение", "ать", "ему", "ях"};
+const char *const kStopwords[] = {"и", "в", "на", "не", "что", "с", "по", "для", "это", "как"};
+
+template <typename T, size_t N>
+const char *pick(const T (&items)[N], std::mt19937_64 &rng) {
+    return items[rng() % N];
+}
+
+// Lemmas of 2-4 open syllables; their order is the Zipf rank
+std::vector<std::string> make_vocabulary(size_t n, std::mt19937_64 &rng) {
+    std::vector<std::string> words;
+    std::unordered_set<std::string> seen;
+    while (words.size() < n) {
+        std::string w;
+        size_t syllables = 2 + rng() % 3;
+        for (size_t s = 0; s < syllables; ++s) w += std::string(pick(kConsonants, rng)) + pick(kVowels, rng);
+        w += pick(kConsonants, rng);
+        if (seen.insert(w).second) words.push_back(std::move(w));
+    }
+    return words;
+}
+
+void append_json_string(std::string &out, const std::string &s) {
+    out += '"';
+    for (char c : s) {
+        if (c == '\n') {
+            out += "\\n";
+            continue;
+        }
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    out += '"';
+}
+
+// Writes the corpus as NDJSON with url/title/raw_html; returns its size in bytes
+uint64_t write_corpus(const Options &opt, const std::vector<std::string> &vocab, const std::string &path) {
+    std::mt19937_64 rng(opt.seed + 1);
+    ZipfSampler zipf(vocab.size(), opt.zipf_s);
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    uint64_t bytes = 0;
+    std::string html, line;
+    for (size_t d = 0; d < opt.docs; ++d) {
+        html = "<html><body><div class=\"article\"><p>";
+        size_t words = opt.words / 2 + rng() % (opt.words + 1);
+        for (size_t i = 0; i < words; ++i) {
+            if (i && i % 40 == 0) html += "</p>\n<p>";
+            if (uniform(rng) < 0.3) {
+                html += pick(kStopwords, rng);
+            } else {
+                html += vocab[zipf(rng)];
+                html += pick(kEndings, rng);
+            }
+            if (rng() % 12 == 0) html += rng() % 2 ? "," : ".";
+            if (rng() % 97 == 0) html += " <a href=\"https://example.ru/" + std::to_string(rng() % 1000) + "\">ссылка</a>";
+            html += ' ';
+        }
+        html += "</p></div></body></html>";
+
+        line = "{\"url\":\"https://example.ru/news/" + std::to_string(d + 1) + "\",\"title\":";
+        append_json_string(line, "Новость " + std::to_string(d + 1));
+        line += ",\"raw_html\":";
+        append_json_string(line, html);
+        line += "}\n";
+        out << line;
+        bytes += line.size();
+    }
+    return bytes;
+}
+
+size_t resident_bytes() {
+    std::ifstream in("/proc/self/statm");
+    size_t pages = 0, resident = 0;
+    in >> pages >> resident;
+    return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+double percentile(std::vector<double> sorted, double p) {
+    if (sorted.empty()) return 0;
+    std::sort(sorted.begin(), sorted.end());
+    return sorted[static_cast<size_t>(p * (sorted.size() - 1))];
+}
+
+struct TermBand {
+    const char *name;
+    std::vector<std::string> words;  // surface forms
+};
+
+// Splits lemmas by document frequency of their normalized form
+std::vector<TermBand> term_bands(const InvertedIndex &index, const std::vector<std::string> &vocab) {
+    std::vector<TermBand> bands = {{"head", {}}, {"mid", {}}, {"tail", {}}};
+    double docs = static_cast<double>(index.doc_count());
+    for (const auto &word : vocab) {
+        const TokenInfo *info = index.find(normalize_term(word));
+        if (!info) continue;
+        double share = info->df / docs;
+        if (share >= 0.10) bands[0].words.push_back(word);
+        else if (share >= 0.01) bands[1].words.push_back(word);
+        else if (share >= 0.001) bands[2].words.push_back(word);
+    }
+    return bands;
+}
+
+std::vector<uint64_t> random_ids(size_t count, uint64_t max_id, std::mt19937_64 &rng) {
+    std::vector<uint64_t> ids(count);
+    for (auto &id : ids) id = 1 + rng() % max_id;
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    return ids;
+}
+
+DocSet doc_set_of(const std::vector<uint64_t> &ids) {
+    PostingList list;
+    for (uint64_t id : ids) list.push_back(id, 1);
+    return DocSet::from_postings(list.view());
+}
+
+// intersect/unite/subtract and contains against the std set algorithms, over
+// pairs of sparse (array chunks) and dense (bitset chunks) sets spanning several chunks
+size_t check_doc_sets(std::mt19937_64 &rng) {
+    size_t mismatches = 0;
+    const uint64_t max_id = 4 * 65536;
+    const size_t sizes[] = {0, 100, 3000, 20000, 150000};
+    for (size_t a_size : sizes) {
+        for (size_t b_size : sizes) {
+            std::vector<uint64_t> a = random_ids(a_size, max_id, rng), b = random_ids(b_size, max_id, rng);
+            DocSet sa = doc_set_of(a), sb = doc_set_of(b);
+            std::vector<uint64_t> both, either, only_a;
+            std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(both));
+            std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(either));
+            std::set_difference(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(only_a));
+            mismatches += sa.ids() != a;
+            mismatches += intersect(sa, sb).ids() != both;
+            mismatches += unite(sa, sb).ids() != either;
+            mismatches += subtract(sa, sb).ids() != only_a;
+            for (int probe = 0; probe < 1000; ++probe) {
+                uint64_t id = 1 + rng() % max_id;
+                mismatches += sa.contains(id) != std::binary_search(a.begin(), a.end(), id);
+            }
+        }
+    }
+    return mismatches;
+}
+
+std::vector<uint64_t> posting_ids(const InvertedIndex &index, const std::string &word) {
+    std::vector<uint64_t> ids;
+    const TokenInfo *info = index.find(normalize_term(word));
+    if (!info) return ids;
+    for (PostingIterator it(info->postings.view()); it.valid(); it.next()) ids.push_back(it.doc());
+    return ids;
+}
+
+// Conjunctions of dense terms (which take the DocSet path) with and without a
+// dense NOT: the matched docs must equal the brute-force intersection, and the
+// top 10 must score like the best 10 of the unpruned result, with and without
+// the query caches
+size_t check_dense_planner(InvertedIndex &index, const std::vector<std::string> &vocab, size_t queries,
+                           std::mt19937_64 &rng) {
+    std::vector<std::string> dense;
+    std::unordered_set<std::string> seen;
+    for (const auto &word : vocab) {
+        std::string term = normalize_term(word);
+        const TokenInfo *info = index.find(term);
+        if (info && info->df > DocSet::kArrayMax && seen.insert(term).second) dense.push_back(word);
+    }
+    if (dense.size() < 3) {
+        std::cout << "  (skipping dense planner check: fewer than 3 terms above " << DocSet::kArrayMax << " docs)\n";
+        return 0;
+    }
+    size_t mismatches = 0;
+    for (bool cached : {false, true}) {
+        index.set_cache_capacity(cached ? 16 << 20 : 0, cached ? 16 << 20 : 0);
+        for (size_t q = 0; q < queries; ++q) {
+            std::string a = dense[rng() % dense.size()], b = dense[rng() % dense.size()];
+            std::string c = dense[rng() % dense.size()];
+            std::vector<uint64_t> expected, ab;
+            std::vector<uint64_t> pa = posting_ids(index, a), pb = posting_ids(index, b), pc = posting_ids(index, c);
+            std::set_intersection(pa.begin(), pa.end(), pb.begin(), pb.end(), std::back_inserter(ab));
+            bool negate = q % 2 == 1 && normalize_term(c) != normalize_term(a) && normalize_term(c) != normalize_term(b);
+            std::string query = a + " & " + b;
+            if (negate) {
+                query += " & !" + c;
+                std::set_difference(ab.begin(), ab.end(), pc.begin(), pc.end(), std::back_inserter(expected));
+            } else {
+                expected = ab;
+            }
+            for (int round = 0; round < 2; ++round) {  // the second round hits the caches
+                std::vector<SearchHit> all = index.search(query);
+                std::vector<uint64_t> got;
+                for (const auto &hit : all) got.push_back(hit.doc_id);
+                std::sort(got.begin(), got.end());
+                mismatches += got != expected;
+
+                std::vector<SearchHit> top = index.search(query, 10);
+                std::sort(all.begin(), all.end(), [](const SearchHit &x, const SearchHit &y) { return x.score > y.score; });
+                all.resize(std::min<size_t>(all.size(), 10));
+                bool same = top.size() == all.size();
+                for (size_t i = 0; same && i < top.size(); ++i) {
+                    same = std::fabs(top[i].score - all[i].score) <= 1e-4f * std::max(1.0f, all[i].score);
+                }
+                mismatches += !same;
+            }
+        }
+    }
+    index.set_cache_capacity(0, 0);
+    return mismatches;
+}
+
+// Cyrillic with Р (D0 A0, whose tail byte is the NBSP code point) next to raw and
+// entity NBSPs must come back from the store exactly as plain_text cleans it
+size_t check_doc_store(const std::string &dir) {
+    const std::string path = dir + "/roundtrip.store";
+    const std::string html = "<p>Новости:\tРоссия и Рим</p>\xC2\xA0Москва&nbsp;Кремль &#160; Р";
+    const std::string body = "Новости: Россия и Рим Москва Кремль Р";
+    DocStoreWriter writer;
+    if (!writer.open(path)) return 1;
+    writer.add(DocumentView{1, "src", "https://example.ru/Р", "Рим\xC2\xA0Россия", html});
+    StoredDoc plain{2, "src", "url", "title", body};
+    writer.add(plain);
+    if (!writer.finish()) return 1;
+
+    DocStore store;
+    if (!store.open(path)) return 1;
+    size_t mismatches = 0;
+    StoredDoc doc;
+    mismatches += !store.get(1, doc) || doc.body != body || doc.title != "Рим\xC2\xA0Россия" ||
+                  doc.url != "https://example.ru/Р";
+    mismatches += !store.get(2, doc) || doc.body != body;
+    mismatches += plain_text(body) != body;
+    store.close();
+    std::filesystem::remove(path);
+    return mismatches;
+}
+
+struct QueryMix {
+    std::string name;
+    std::vector<std::string> queries;
+};
+
+std::vector<QueryMix> make_query_mixes(const std::vector<TermBand> &bands, size_t count, std::mt19937_64 &rng) {
+    const auto &head = bands[0].words, &mid = bands[1].words, &tail = bands[2].words;
+    auto any = [&rng](const std::vector<std::string> &words) { return words[rng() % words.size()]; };
+    struct Shape {
+        const char *name;
+        std::vector<const std::vector<std::string> *> terms;
+        const char *op;
+    };
+    std::vector<Shape> shapes = {
+        {"and_head_head", {&head, &head}, " & "},
+        {"and_head_tail", {&head, &tail}, " & "},
+        {"and_mid_mid_mid", {&mid, &mid, &mid}, " & "},
+        {"or_head_head", {&head, &head}, " | "},
+        {"or_mid_tail_tail", {&mid, &tail, &tail}, " | "},
+    };
+    std::vector<QueryMix> mixes;
+    for (const auto &shape : shapes) {
+        bool usable = std::all_of(shape.terms.begin(), shape.terms.end(), [](const auto *w) { return !w->empty(); });
+        if (!usable) {
+            std::cout << "  (skipping " << shape.name << ": no terms in that frequency band)\n";
+            continue;
+        }
+        QueryMix mix{shape.name, {}};
+        for (size_t q = 0; q < count; ++q) {
+            std::string query;
+            for (size_t t = 0; t < shape.terms.size(); ++t) {
+                if (t) query += shape.op;
+                query += any(*shape.terms[t]);
+            }
+            mix.queries.push_back(std::move(query));
+        }
+        mixes.push_back(std::move(mix));
+    }
+    return mixes;
+}
+}
+
+int main(int argc, char **argv) {
+    Options opt;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--docs=", 0) == 0) {
+            opt.docs = std::stoul(arg.substr(7));
+        } else if (arg.rfind("--words=", 0) == 0) {
+            opt.words = std::stoul(arg.substr(8));
+        } else if (arg.rfind("--vocab=", 0) == 0) {
+            opt.vocab = std::stoul(arg.substr(8));
+        } else if (arg.rfind("--zipf-s=", 0) == 0) {
+            opt.zipf_s = std::stod(arg.substr(9));
+        } else if (arg.rfind("--queries=", 0) == 0) {
+            opt.queries = std::stoul(arg.substr(10));
+        } else if (arg.rfind("--seed=", 0) == 0) {
+            opt.seed = std::stoull(arg.substr(7));
+        } else if (arg.rfind("--dir=", 0) == 0) {
+            opt.dir = arg.substr(6);
+        } else if (arg.rfind("--out=", 0) == 0) {
+            opt.out = arg.substr(6);
+        }
+    }
+
+    std::filesystem::create_directories(opt.dir);
+    std::string corpus_path = opt.dir + "/corpus.ndjson";
+    std::mt19937_64 rng(opt.seed);
+    std::vector<std::string> vocab = make_vocabulary(opt.vocab, rng);
+
+    std::cout << "[INFO] Generating " << opt.docs << " documents into " << corpus_path << "..." << std::endl;
+    uint64_t corpus_bytes = write_corpus(opt, vocab, corpus_path);
+    double mb = corpus_bytes / 1048576.0;
+
+    Report report(opt.out);
+    std::cout << "\n[BENCH]\n";
+    report.add("corpus_docs", static_cast<double>(opt.docs), "docs");
+    report.add("corpus_size", mb, "MB");
+
+    // Loader: mmap + NDJSON field scan only
+    auto start = Clock::now();
+    size_t loaded = 0;
+    process_ndjson_views(corpus_path, [&](const DocumentView &) { ++loaded; }, 0);
+    report.add("loader_throughput", mb / seconds_since(start), "MB/s");
+
+    std::vector<Document> docs = load_documents_from_ndjson(corpus_path);
+
+    // Tokenizer: tags, folding, stopwords and stemming into a reused counter
+    TermCounter counter;
+    TokenizationStats tstats;
+    uint64_t text_bytes = 0;
+    start = Clock::now();
+    for (const auto &doc : docs) {
+        counter.clear();
+        tokenize_document(doc.text, counter, tstats);
+        text_bytes += doc.text.size();
+    }
+    double took = seconds_since(start);
+    report.add("tokenize_throughput", text_bytes / 1048576.0 / took, "MB/s");
+    report.add("tokenize_tokens", tstats.tokens / took / 1e6, "Mtokens/s");
+
+    // Stemmer on inflected surface forms
+    std::vector<std::string> forms;
+    for (size_t i = 0; i < 100000; ++i) forms.push_back(vocab[rng() % vocab.size()] + pick(kEndings, rng));
+    size_t stem_bytes = 0;
+    start = Clock::now();
+    for (int round = 0; round < 10; ++round) {
+        for (const auto &w : forms) stem_bytes += stem_word(w).size();
+    }
+    report.add("stem_word", seconds_since(start) * 1e9 / (forms.size() * 10.0), "ns/call");
+    report.add("stem_avg_length", stem_bytes / (forms.size() * 10.0), "bytes");
+
+    // Indexing
+    size_t rss_before = resident_bytes();
+    InvertedIndex index;
+    start = Clock::now();
+    for (const auto &doc : docs) index.add_document(doc);
+    took = seconds_since(start);
+    report.add("add_document", docs.size() / took, "docs/s");
+    report.add("add_document_bytes", text_bytes / 1048576.0 / took, "MB/s");
+    size_t posting_bytes = 0;
+    for (const auto &info : index.terms()) posting_bytes += info.postings.byte_size();
+    report.add("index_postings", posting_bytes / 1048576.0, "MB");
+    report.add("index_rss_growth", (resident_bytes() - std::min(resident_bytes(), rss_before)) / 1048576.0, "MB");
+    report.add("index_vocabulary", static_cast<double>(index.vocab_size()), "terms");
+
+    // How closely the generated corpus follows the Zipf model over the top ranks
+    auto rows = build_zipf_rows(index);
+    double deviation = 0;
+    size_t top = std::min<size_t>(rows.size(), 1000);
+    for (size_t r = 0; r < top; ++r) deviation += std::fabs(rows[r].log_freq - rows[r].log_zipf_expected);
+    report.add("zipf_log_deviation", top ? deviation / top : 0.0, "log10");
+
+    // Search: k = 10 latency per mix; selectivity from full result counts
+    std::vector<TermBand> bands = term_bands(index, vocab);
+    for (const auto &mix : make_query_mixes(bands, opt.queries, rng)) {
+        std::vector<double> latency;
+        latency.reserve(mix.queries.size());
+        size_t hits = 0;
+        start = Clock::now();
+        for (const auto &q : mix.queries) {
+            auto t0 = Clock::now();
+            hits += index.search(q, 10).size();
+            latency.push_back(seconds_since(t0) * 1e6);
+        }
+        took = seconds_since(start);
+        double matches = 0;
+        size_t sampled = std::min<size_t>(mix.queries.size(), 100);
+        for (size_t q = 0; q < sampled; ++q) matches += index.search(mix.queries[q]).size();
+
+        report.add("search_" + mix.name + "_qps", mix.queries.size() / took, "queries/s");
+        report.add("search_" + mix.name + "_p50", percentile(latency, 0.50), "us");
+        report.add("search_" + mix.name + "_p90", percentile(latency, 0.90), "us");
+        report.add("search_" + mix.name + "_p99", percentile(latency, 0.99), "us");
+        report.add("search_" + mix.name + "_max", percentile(latency, 1.0), "us");
+        report.add("search_" + mix.name + "_selectivity",
+                   sampled ? matches / sampled / static_cast<double>(index.doc_count()) : 0.0, "of docs");
+        if (hits == 0) std::cout << "  (" << mix.name << " returned no hits)\n";
+    }
+
+    size_t doc_store_mismatches = check_doc_store(opt.dir);
+    report.add("doc_store_mismatches", static_cast<double>(doc_store_mismatches), "checks");
+    size_t doc_set_mismatches = check_doc_sets(rng);
+    report.add("doc_set_mismatches", static_cast<double>(doc_set_mismatches), "checks");
+    size_t planner_mismatches = check_dense_planner(index, vocab, std::min<size_t>(opt.queries, 200), rng);
+    report.add("dense_planner_mismatches", static_cast<double>(planner_mismatches), "checks");
+
+    std::cout << "\n[OUTPUT]\n  " << opt.out << std::endl;
+    return doc_store_mismatches || doc_set_mismatches || planner_mismatches ? 1 : 0;
+}
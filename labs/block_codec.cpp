@@ -0,0 +1,108 @@
+#include "block_codec.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace {
+constexpr size_t kMinMatch = 4;
+constexpr size_t kLastLiterals = 5;
+constexpr size_t kMaxOffset = 65535;
+constexpr unsigned kHashBits = 14;
+
+inline uint32_t read32(const char *p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint32_t hash4(uint32_t v) {
+    return (v * 2654435761u) >> (32 - kHashBits);
+}
+
+void put_length(std::string &out, size_t len) {
+    for (; len >= 255; len -= 255) out += static_cast<char>(255);
+    out += static_cast<char>(len);
+}
+
+void emit(std::string &out, const char *literals, size_t literal_len, size_t offset, size_t match_len) {
+    size_t extra_match = match_len ? match_len - kMinMatch : 0;
+    uint8_t token = static_cast<uint8_t>((std::min<size_t>(literal_len, 15) << 4) | std::min<size_t>(extra_match, 15));
+    out += static_cast<char>(token);
+    if (literal_len >= 15) put_length(out, literal_len - 15);
+    out.append(literals, literal_len);
+    if (!match_len) return;
+    out += static_cast<char>(offset & 0xFF);
+    out += static_cast<char>(offset >> 8);
+    if (extra_match >= 15) put_length(out, extra_match - 15);
+}
+
+bool read_length(const uint8_t *&p, const uint8_t *end, size_t &len) {
+    uint8_t b;
+    do {
+        if (p == end) return false;
+        b = *p++;
+        len += b;
+    } while (b == 255);
+    return true;
+}
+}
+
+void lz_compress(std::string_view in, std::string &out) {
+    const char *src = in.data();
+    const size_t n = in.size();
+    size_t anchor = 0;
+    if (n > kMinMatch + kLastLiterals) {
+        // Positions + 1 of the last 4-byte sequence with each hash; 0 = none
+        std::vector<uint32_t> table(size_t(1) << kHashBits, 0);
+        const size_t limit = n - kLastLiterals - kMinMatch;
+        size_t i = 0;
+        while (i <= limit) {
+            uint32_t seq = read32(src + i);
+            uint32_t &slot = table[hash4(seq)];
+            size_t candidate = slot;
+            slot = static_cast<uint32_t>(i + 1);
+            if (!candidate || i - (candidate - 1) > kMaxOffset || read32(src + candidate - 1) != seq) {
+                ++i;
+                continue;
+            }
+            size_t from = candidate - 1;
+            size_t len = kMinMatch;
+            while (i + len < n - kLastLiterals && src[from + len] == src[i + len]) ++len;
+            emit(out, src + anchor, i - anchor, i - from, len);
+            i += len;
+            anchor = i;
+            if (i - 2 <= limit) table[hash4(read32(src + i - 2))] = static_cast<uint32_t>(i - 1);
+        }
+    }
+    emit(out, src + anchor, n - anchor, 0, 0);
+}
+
+bool lz_decompress(const uint8_t *in, size_t in_len, char *out, size_t raw_len) {
+    const uint8_t *p = in;
+    const uint8_t *end = in + in_len;
+    size_t written = 0;
+    while (p < end) {
+        uint8_t token = *p++;
+        size_t literal_len = token >> 4;
+        if (literal_len == 15 && !read_length(p, end, literal_len)) return false;
+        if (literal_len > static_cast<size_t>(end - p) || literal_len > raw_len - written) return false;
+        std::memcpy(out + written, p, literal_len);
+        p += literal_len;
+        written += literal_len;
+        if (p == end) break;  // the last sequence has no match
+
+        if (end - p < 2) return false;
+        size_t offset = p[0] | (static_cast<size_t>(p[1]) << 8);
+        p += 2;
+        size_t match_len = token & 0x0F;
+        if (match_len == 15 && !read_length(p, end, match_len)) return false;
+        match_len += kMinMatch;
+        if (offset == 0 || offset > written || match_len > raw_len - written) return false;
+        // Byte by byte: the source may overlap what is being written
+        const char *from = out + written - offset;
+        for (size_t k = 0; k < match_len; ++k) out[written + k] = from[k];
+        written += match_len;
+    }
+    return written == raw_len;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// LZ77 byte codec in the LZ4 block format: sequences of a token byte (literal
+// and match length nibbles, 15 = more length bytes follow), literals, a 2-byte
+// little-endian match offset and extra match length. Matches are at least 4
+// bytes and reach back at most 64 KB; the last 5 bytes are always literals.
+// Fast on text with repeated markup and words, no entropy coding.
+
+// Appends the compressed form of in to out
+void lz_compress(std::string_view in, std::string &out);
+// Decodes exactly raw_len bytes into out; false on malformed or truncated input
+bool lz_decompress(const uint8_t *in, size_t in_len, char *out, size_t raw_len);
@@ -0,0 +1,48 @@
+#include "buffered_writer.hpp"
+
+#include <charconv>
+#include <iostream>
+
+bool BufferedWriter::open(const std::string &path) {
+    path_ = path;
+    out_.open(path, std::ios::binary | std::ios::trunc);
+    if (!out_) {
+        std::cerr << "Cannot write file: " << path << "\n";
+        return false;
+    }
+    buffer_.clear();
+    buffer_.reserve(kBufferSize);
+    return true;
+}
+
+bool BufferedWriter::close() {
+    flush();
+    out_.close();
+    if (!out_) {
+        std::cerr << "Cannot write file: " << path_ << "\n";
+        return false;
+    }
+    return true;
+}
+
+void BufferedWriter::flush() {
+    out_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+    buffer_.clear();
+}
+
+void BufferedWriter::put_uint(uint64_t v) {
+    char digits[20];
+    char *end = digits + sizeof(digits);
+    char *p = end;
+    do {
+        *--p = static_cast<char>('0' + v % 10);
+        v /= 10;
+    } while (v);
+    put(std::string_view(p, static_cast<size_t>(end - p)));
+}
+
+void BufferedWriter::put_double(double v) {
+    char text[32];
+    auto result = std::to_chars(text, text + sizeof(text), v, std::chars_format::general, 6);
+    put(std::string_view(text, static_cast<size_t>(result.ptr - text)));
+}
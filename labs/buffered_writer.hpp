@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
+
+// Text output through one large buffer; numbers are formatted by hand instead
+// of through ostream, with doubles printed like ostream's default (%g, 6 digits)
+class BufferedWriter {
+public:
+    static constexpr size_t kBufferSize = 1 << 20;
+
+    bool open(const std::string &path);
+    // Flushes and closes; false if any write failed
+    bool close();
+
+    void put(std::string_view s) {
+        if (buffer_.size() + s.size() > kBufferSize) flush();
+        buffer_.append(s.data(), s.size());
+    }
+    void put(char c) {
+        if (buffer_.size() == kBufferSize) flush();
+        buffer_ += c;
+    }
+    void put_uint(uint64_t v);
+    void put_double(double v);
+
+private:
+    std::string path_;
+    std::ofstream out_;
+    std::string buffer_;
+
+    void flush();
+};
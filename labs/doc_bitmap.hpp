@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Bitset over doc ids starting at first(); grows on set(). Used for tombstones.
+class DocBitmap {
+public:
+    DocBitmap() = default;
+    explicit DocBitmap(uint64_t first) : first_(first) {}
+
+    uint64_t first() const { return first_; }
+    size_t count() const { return count_; }
+    bool empty() const { return count_ == 0; }
+
+    bool test(uint64_t id) const {
+        if (id < first_) return false;
+        uint64_t bit = id - first_;
+        size_t word = static_cast<size_t>(bit >> 6);
+        return word < words_.size() && ((words_[word] >> (bit & 63)) & 1);
+    }
+
+    void set(uint64_t id) {
+        if (id < first_ || test(id)) return;
+        uint64_t bit = id - first_;
+        size_t word = static_cast<size_t>(bit >> 6);
+        if (word >= words_.size()) words_.resize(word + 1, 0);
+        words_[word] |= uint64_t(1) << (bit & 63);
+        ++count_;
+    }
+
+    std::vector<uint64_t> ids() const {
+        std::vector<uint64_t> out;
+        out.reserve(count_);
+        for (size_t w = 0; w < words_.size(); ++w) {
+            for (uint64_t bits = words_[w]; bits; bits &= bits - 1) {
+                out.push_back(first_ + (w << 6) + static_cast<uint64_t>(__builtin_ctzll(bits)));
+            }
+        }
+        return out;
+    }
+
+private:
+    uint64_t first_{0};
+    std::vector<uint64_t> words_;
+    size_t count_{0};
+};
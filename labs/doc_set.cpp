@@ -0,0 +1,220 @@
+#include "doc_set.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+namespace {
+uint32_t popcount(const std::vector<uint64_t> &words) {
+    uint32_t count = 0;
+    for (uint64_t w : words) count += static_cast<uint32_t>(__builtin_popcountll(w));
+    return count;
+}
+
+std::vector<uint64_t> to_bits(const std::vector<uint16_t> &array) {
+    std::vector<uint64_t> bits(DocSet::kChunkWords, 0);
+    for (uint16_t low : array) bits[low >> 6] |= uint64_t(1) << (low & 63);
+    return bits;
+}
+
+std::vector<uint16_t> to_array(const std::vector<uint64_t> &bits, uint32_t count) {
+    std::vector<uint16_t> array;
+    array.reserve(count);
+    for (size_t w = 0; w < bits.size(); ++w) {
+        for (uint64_t word = bits[w]; word; word &= word - 1) {
+            array.push_back(static_cast<uint16_t>((w << 6) + static_cast<size_t>(__builtin_ctzll(word))));
+        }
+    }
+    return array;
+}
+
+// Bitsets that shrank to kArrayMax ids or fewer become arrays again, and
+// arrays that grew past it become bitsets
+void normalize(std::vector<uint16_t> &array, std::vector<uint64_t> &bits, uint32_t count) {
+    if (!bits.empty() && count <= DocSet::kArrayMax) {
+        array = to_array(bits, count);
+        bits.clear();
+        bits.shrink_to_fit();
+    } else if (bits.empty() && count > DocSet::kArrayMax) {
+        bits = to_bits(array);
+        array.clear();
+        array.shrink_to_fit();
+    }
+}
+}
+
+bool DocSet::Chunk::test(uint16_t low) const {
+    if (is_bitset()) return (bits[low >> 6] >> (low & 63)) & 1;
+    return std::binary_search(array.begin(), array.end(), low);
+}
+
+DocSet DocSet::from_postings(const PostingListView &list) {
+    DocSet set;
+    Chunk chunk;
+    for (PostingIterator it(list); it.valid(); it.next()) {
+        uint64_t key = it.doc() >> 16;
+        if (chunk.count && key != chunk.key) {
+            set.push(std::move(chunk));
+            chunk = Chunk{};
+        }
+        chunk.key = key;
+        auto low = static_cast<uint16_t>(it.doc() & 0xFFFF);
+        if (chunk.is_bitset()) {
+            chunk.bits[low >> 6] |= uint64_t(1) << (low & 63);
+        } else {
+            chunk.array.push_back(low);
+            if (chunk.array.size() > kArrayMax) {
+                chunk.bits = to_bits(chunk.array);
+                chunk.array.clear();
+                chunk.array.shrink_to_fit();
+            }
+        }
+        ++chunk.count;
+    }
+    if (chunk.count) set.push(std::move(chunk));
+    return set;
+}
+
+void DocSet::push(Chunk &&chunk) {
+    if (!chunk.count) return;
+    size_ += chunk.count;
+    chunks_.push_back(std::move(chunk));
+}
+
+size_t DocSet::byte_size() const {
+    size_t bytes = chunks_.capacity() * sizeof(Chunk);
+    for (const auto &c : chunks_) bytes += c.array.capacity() * sizeof(uint16_t) + c.bits.capacity() * sizeof(uint64_t);
+    return bytes;
+}
+
+bool DocSet::contains(uint64_t doc) const {
+    auto it = std::lower_bound(chunks_.begin(), chunks_.end(), doc >> 16,
+                               [](const Chunk &c, uint64_t key) { return c.key < key; });
+    return it != chunks_.end() && it->key == doc >> 16 && it->test(static_cast<uint16_t>(doc & 0xFFFF));
+}
+
+std::vector<uint64_t> DocSet::ids() const {
+    std::vector<uint64_t> out;
+    out.reserve(size_);
+    for (const auto &c : chunks_) {
+        uint64_t base = c.key << 16;
+        if (!c.is_bitset()) {
+            for (uint16_t low : c.array) out.push_back(base + low);
+            continue;
+        }
+        for (size_t w = 0; w < kChunkWords; ++w) {
+            for (uint64_t word = c.bits[w]; word; word &= word - 1) {
+                out.push_back(base + (w << 6) + static_cast<uint64_t>(__builtin_ctzll(word)));
+            }
+        }
+    }
+    return out;
+}
+
+DocSet::Chunk DocSet::and_chunks(const Chunk &a, const Chunk &b) {
+    Chunk out;
+    out.key = a.key;
+    if (a.is_bitset() && b.is_bitset()) {
+        out.bits.resize(kChunkWords);
+        for (size_t w = 0; w < kChunkWords; ++w) out.bits[w] = a.bits[w] & b.bits[w];
+        out.count = popcount(out.bits);
+    } else if (a.is_bitset() || b.is_bitset()) {
+        const Chunk &array = a.is_bitset() ? b : a;
+        const Chunk &bitset = a.is_bitset() ? a : b;
+        for (uint16_t low : array.array) {
+            if (bitset.test(low)) out.array.push_back(low);
+        }
+        out.count = static_cast<uint32_t>(out.array.size());
+    } else {
+        std::set_intersection(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+                              std::back_inserter(out.array));
+        out.count = static_cast<uint32_t>(out.array.size());
+    }
+    normalize(out.array, out.bits, out.count);
+    return out;
+}
+
+DocSet::Chunk DocSet::or_chunks(const Chunk &a, const Chunk &b) {
+    Chunk out;
+    out.key = a.key;
+    if (a.is_bitset() && b.is_bitset()) {
+        out.bits.resize(kChunkWords);
+        for (size_t w = 0; w < kChunkWords; ++w) out.bits[w] = a.bits[w] | b.bits[w];
+        out.count = popcount(out.bits);
+    } else if (a.is_bitset() || b.is_bitset()) {
+        const Chunk &array = a.is_bitset() ? b : a;
+        out.bits = (a.is_bitset() ? a : b).bits;
+        for (uint16_t low : array.array) out.bits[low >> 6] |= uint64_t(1) << (low & 63);
+        out.count = popcount(out.bits);
+    } else {
+        std::set_union(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(), std::back_inserter(out.array));
+        out.count = static_cast<uint32_t>(out.array.size());
+    }
+    normalize(out.array, out.bits, out.count);
+    return out;
+}
+
+DocSet::Chunk DocSet::and_not_chunks(const Chunk &a, const Chunk &b) {
+    Chunk out;
+    out.key = a.key;
+    if (a.is_bitset() && b.is_bitset()) {
+        out.bits.resize(kChunkWords);
+        for (size_t w = 0; w < kChunkWords; ++w) out.bits[w] = a.bits[w] & ~b.bits[w];
+        out.count = popcount(out.bits);
+    } else if (a.is_bitset()) {
+        out.bits = a.bits;
+        for (uint16_t low : b.array) out.bits[low >> 6] &= ~(uint64_t(1) << (low & 63));
+        out.count = popcount(out.bits);
+    } else if (b.is_bitset()) {
+        for (uint16_t low : a.array) {
+            if (!b.test(low)) out.array.push_back(low);
+        }
+        out.count = static_cast<uint32_t>(out.array.size());
+    } else {
+        std::set_difference(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+                            std::back_inserter(out.array));
+        out.count = static_cast<uint32_t>(out.array.size());
+    }
+    normalize(out.array, out.bits, out.count);
+    return out;
+}
+
+DocSet intersect(const DocSet &a, const DocSet &b) {
+    DocSet out;
+    auto i = a.chunks_.begin(), j = b.chunks_.begin();
+    while (i != a.chunks_.end() && j != b.chunks_.end()) {
+        if (i->key < j->key) {
+            ++i;
+        } else if (j->key < i->key) {
+            ++j;
+        } else {
+            out.push(DocSet::and_chunks(*i++, *j++));
+        }
+    }
+    return out;
+}
+
+DocSet unite(const DocSet &a, const DocSet &b) {
+    DocSet out;
+    auto i = a.chunks_.begin(), j = b.chunks_.begin();
+    while (i != a.chunks_.end() || j != b.chunks_.end()) {
+        if (j == b.chunks_.end() || (i != a.chunks_.end() && i->key < j->key)) {
+            out.push(DocSet::Chunk(*i++));
+        } else if (i == a.chunks_.end() || j->key < i->key) {
+            out.push(DocSet::Chunk(*j++));
+        } else {
+            out.push(DocSet::or_chunks(*i++, *j++));
+        }
+    }
+    return out;
+}
+
+DocSet subtract(const DocSet &a, const DocSet &b) {
+    DocSet out;
+    auto j = b.chunks_.begin();
+    for (const auto &chunk : a.chunks_) {
+        while (j != b.chunks_.end() && j->key < chunk.key) ++j;
+        if (j != b.chunks_.end() && j->key == chunk.key) out.push(DocSet::and_not_chunks(chunk, *j));
+        else out.push(DocSet::Chunk(chunk));
+    }
+    return out;
+}
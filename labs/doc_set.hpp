@@ -0,0 +1,56 @@
+#pragma once
+
+#include "postings.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Compressed doc id set in the style of Roaring bitmaps: ids are split into
+// chunks of 65536 by their high bits, and each chunk keeps its low 16 bits as a
+// sorted array while sparse or as a 1024-word bitset once it holds more than
+// kArrayMax ids. Set operations work chunk by chunk, and bitset pairs are
+// combined a whole word at a time in loops the compiler vectorizes.
+class DocSet {
+public:
+    static constexpr uint32_t kArrayMax = 4096;
+    static constexpr size_t kChunkWords = 65536 / 64;
+
+    DocSet() = default;
+    static DocSet from_postings(const PostingListView &list);
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    size_t byte_size() const;
+    bool contains(uint64_t doc) const;
+    // Ascending
+    std::vector<uint64_t> ids() const;
+
+    friend DocSet intersect(const DocSet &a, const DocSet &b);
+    friend DocSet unite(const DocSet &a, const DocSet &b);
+    // Ids of a that are not in b
+    friend DocSet subtract(const DocSet &a, const DocSet &b);
+
+private:
+    struct Chunk {
+        uint64_t key{0};              // doc id >> 16
+        uint32_t count{0};
+        std::vector<uint16_t> array;  // sorted low bits while count <= kArrayMax
+        std::vector<uint64_t> bits;   // kChunkWords words otherwise
+
+        bool is_bitset() const { return !bits.empty(); }
+        bool test(uint16_t low) const;
+    };
+
+    std::vector<Chunk> chunks_;  // ascending keys, none empty
+    size_t size_{0};
+
+    void push(Chunk &&chunk);
+    static Chunk and_chunks(const Chunk &a, const Chunk &b);
+    static Chunk or_chunks(const Chunk &a, const Chunk &b);
+    static Chunk and_not_chunks(const Chunk &a, const Chunk &b);
+};
+
+DocSet intersect(const DocSet &a, const DocSet &b);
+DocSet unite(const DocSet &a, const DocSet &b);
+DocSet subtract(const DocSet &a, const DocSet &b);
@@ -0,0 +1,279 @@
+#include "doc_store.hpp"
+#include "block_codec.hpp"
+#include "postings.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+
+namespace {
+void write_bytes(std::ofstream &out, const void *data, size_t size, uint64_t &pos) {
+    out.write(static_cast<const char *>(data), static_cast<std::streamsize>(size));
+    pos += size;
+}
+
+void write_padding(std::ofstream &out, uint64_t &pos) {
+    static const char zeros[8] = {};
+    write_bytes(out, zeros, segment::align8(pos) - pos, pos);
+}
+
+void append_utf8(std::string &out, uint32_t cp) {
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x110000) {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+// html[i] == '&'; returns the index after ';' of a known entity, or 0
+size_t decode_entity(std::string_view html, size_t i, uint32_t &cp) {
+    size_t semi = html.find(';', i + 1);
+    if (semi == std::string_view::npos || semi - i > 10) return 0;
+    std::string_view name = html.substr(i + 1, semi - i - 1);
+    if (name.size() > 1 && name[0] == '#') {
+        bool hex = name[1] == 'x' || name[1] == 'X';
+        std::string_view digits = name.substr(hex ? 2 : 1);
+        if (digits.empty()) return 0;
+        cp = 0;
+        for (char c : digits) {
+            int digit = c >= '0' && c <= '9' ? c - '0'
+                        : hex && c >= 'a' && c <= 'f' ? c - 'a' + 10
+                        : hex && c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+            if (digit < 0) return 0;
+            cp = cp * (hex ? 16 : 10) + static_cast<uint32_t>(digit);
+            if (cp > 0x10FFFF) return 0;
+        }
+    } else if (name == "amp") {
+        cp = '&';
+    } else if (name == "lt") {
+        cp = '<';
+    } else if (name == "gt") {
+        cp = '>';
+    } else if (name == "quot") {
+        cp = '"';
+    } else if (name == "apos") {
+        cp = '\'';
+    } else if (name == "nbsp") {
+        cp = 0xA0;
+    } else {
+        return 0;
+    }
+    return semi + 1;
+}
+
+bool is_space(uint32_t cp) {
+    return cp == ' ' || cp == '\t' || cp == '\n' || cp == '\r' || cp == '\f' || cp == '\v' || cp == 0xA0;
+}
+
+std::atomic<uint64_t> g_store_generation{0};
+
+struct DecodedBlock {
+    uint64_t generation{0};
+    uint32_t block{0};
+    std::string raw;
+};
+thread_local DecodedBlock tls_block;
+}
+
+std::string plain_text(std::string_view html) {
+    std::string out;
+    out.reserve(html.size() / 2);
+    bool space = false;
+    size_t i = 0;
+    while (i < html.size()) {
+        char c = html[i];
+        if (c == '<') {
+            size_t close = html.find('>', i + 1);
+            i = close == std::string_view::npos ? html.size() : close + 1;
+            continue;
+        }
+        // Only an entity or a whole C2 A0 sequence is decoded; other bytes are copied
+        // as they are, since 0xA0 alone is also the tail of letters such as Р (D0 A0)
+        uint32_t cp = static_cast<unsigned char>(c);
+        size_t next = c == '&' ? decode_entity(html, i, cp) : 0;
+        if (!next && c == '\xC2' && i + 1 < html.size() && html[i + 1] == '\xA0') {
+            cp = 0xA0;
+            next = i + 2;
+        }
+        bool decoded = next != 0;
+        if (!decoded && cp >= 0x80) cp = 0;
+        i = decoded ? next : i + 1;
+        if (is_space(cp)) {
+            space = true;
+            continue;
+        }
+        if (space && !out.empty()) out += ' ';
+        space = false;
+        if (decoded) append_utf8(out, cp);
+        else out += c;
+    }
+    return out;
+}
+
+bool DocStoreWriter::open(const std::string &path) {
+    path_ = path;
+    out_.open(path, std::ios::binary | std::ios::trunc);
+    if (!out_) {
+        std::cerr << "Cannot write document store: " << path << "\n";
+        return false;
+    }
+    docstore::Header header{};
+    pos_ = 0;
+    write_bytes(out_, &header, sizeof(header), pos_);  // rewritten by finish()
+    block_.clear();
+    blocks_.clear();
+    entries_.clear();
+    raw_bytes_ = 0;
+    return true;
+}
+
+void DocStoreWriter::add(const DocumentView &doc) {
+    add_record(doc.id, doc.source, doc.url, doc.title, plain_text(doc.text));
+}
+
+void DocStoreWriter::add(const StoredDoc &doc) {
+    add_record(doc.id, doc.source, doc.url, doc.title, doc.body);
+}
+
+void DocStoreWriter::add_record(uint64_t id, std::string_view source, std::string_view url, std::string_view title,
+                                std::string_view body) {
+    entries_.push_back({id, static_cast<uint32_t>(blocks_.size()), static_cast<uint32_t>(block_.size())});
+    for (std::string_view field : {source, url, title, body}) write_varint(block_, field.size());
+    block_.append(source.data(), source.size());
+    block_.append(url.data(), url.size());
+    block_.append(title.data(), title.size());
+    block_.append(body.data(), body.size());
+    if (block_.size() >= docstore::kBlockSize) flush_block();
+}
+
+void DocStoreWriter::flush_block() {
+    if (block_.empty()) return;
+    compressed_.clear();
+    lz_compress(block_, compressed_);
+    docstore::Block block{pos_, 0, static_cast<uint32_t>(block_.size())};
+    if (compressed_.size() < block_.size()) {
+        block.compressed_len = static_cast<uint32_t>(compressed_.size());
+        write_bytes(out_, compressed_.data(), compressed_.size(), pos_);
+    } else {
+        block.compressed_len = block.raw_len;
+        write_bytes(out_, block_.data(), block_.size(), pos_);
+    }
+    blocks_.push_back(block);
+    raw_bytes_ += block_.size();
+    block_.clear();
+}
+
+bool DocStoreWriter::finish() {
+    flush_block();
+    docstore::Header header{};
+    std::memcpy(header.magic, docstore::kMagic, sizeof(docstore::kMagic));
+    header.version = docstore::kVersion;
+    header.doc_count = entries_.size();
+    header.block_count = blocks_.size();
+    header.raw_bytes = raw_bytes_;
+    write_padding(out_, pos_);
+    header.blocks_off = pos_;
+    write_bytes(out_, blocks_.data(), blocks_.size() * sizeof(docstore::Block), pos_);
+    header.entries_off = pos_;
+    write_bytes(out_, entries_.data(), entries_.size() * sizeof(docstore::Entry), pos_);
+    header.file_size = pos_;
+    out_.seekp(0);
+    out_.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out_.close();
+    if (!out_) {
+        std::cerr << "Cannot write document store: " << path_ << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool DocStore::open(const std::string &path) {
+    close();
+    if (!file_.open(path)) {
+        std::cerr << "Cannot map document store: " << path << "\n";
+        return false;
+    }
+    const char *base = file_.data();
+    size_t size = file_.size();
+    header_ = reinterpret_cast<const docstore::Header *>(base);
+    if (size < sizeof(docstore::Header) ||
+        std::memcmp(header_->magic, docstore::kMagic, sizeof(docstore::kMagic)) != 0 ||
+        header_->version != docstore::kVersion || header_->file_size != size ||
+        header_->blocks_off + header_->block_count * sizeof(docstore::Block) > size ||
+        header_->entries_off + header_->doc_count * sizeof(docstore::Entry) > size) {
+        std::cerr << "Unsupported or corrupt document store: " << path << "\n";
+        close();
+        return false;
+    }
+    blocks_ = reinterpret_cast<const docstore::Block *>(base + header_->blocks_off);
+    entries_ = reinterpret_cast<const docstore::Entry *>(base + header_->entries_off);
+    generation_ = ++g_store_generation;
+    return true;
+}
+
+void DocStore::close() {
+    file_.close();
+    header_ = nullptr;
+    blocks_ = nullptr;
+    entries_ = nullptr;
+    generation_ = 0;
+}
+
+const std::string *DocStore::raw_block(uint32_t block) const {
+    DecodedBlock &cached = tls_block;
+    if (cached.generation == generation_ && cached.block == block) return &cached.raw;
+    if (block >= header_->block_count) return nullptr;
+    const docstore::Block &b = blocks_[block];
+    if (b.offset + b.compressed_len > file_.size()) return nullptr;
+    const uint8_t *data = reinterpret_cast<const uint8_t *>(file_.data() + b.offset);
+    cached.generation = 0;
+    cached.raw.resize(b.raw_len);
+    if (b.compressed_len == b.raw_len) {
+        std::memcpy(&cached.raw[0], data, b.raw_len);
+    } else if (!lz_decompress(data, b.compressed_len, &cached.raw[0], b.raw_len)) {
+        return nullptr;
+    }
+    cached.generation = generation_;
+    cached.block = block;
+    return &cached.raw;
+}
+
+bool DocStore::get(uint64_t doc_id, StoredDoc &doc) const {
+    if (!header_) return false;
+    const docstore::Entry *end = entries_ + header_->doc_count;
+    const docstore::Entry *entry = std::lower_bound(entries_, end, doc_id,
+                                                    [](const docstore::Entry &e, uint64_t id) { return e.id < id; });
+    if (entry == end || entry->id != doc_id) return false;
+    const std::string *raw = raw_block(entry->block);
+    if (!raw || entry->offset > raw->size()) return false;
+
+    const char *p = raw->data() + entry->offset;
+    const char *stop = raw->data() + raw->size();
+    uint64_t lengths[4];
+    for (auto &len : lengths) {
+        const uint8_t *q = reinterpret_cast<const uint8_t *>(p);
+        if (p == stop) return false;
+        len = read_varint(q);
+        p = reinterpret_cast<const char *>(q);
+        if (p > stop) return false;
+    }
+    std::string *fields[4] = {&doc.source, &doc.url, &doc.title, &doc.body};
+    for (size_t f = 0; f < 4; ++f) {
+        if (lengths[f] > static_cast<uint64_t>(stop - p)) return false;
+        fields[f]->assign(p, lengths[f]);
+        p += lengths[f];
+    }
+    doc.id = doc_id;
+    return true;
+}
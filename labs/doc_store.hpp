@@ -0,0 +1,69 @@
+#pragma once
+
+#include "index_format.hpp"
+#include "mapped_file.hpp"
+#include "tokenizer.hpp"
+
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct StoredDoc {
+    uint64_t id{0};
+    std::string source;
+    std::string url;
+    std::string title;
+    std::string body;  // plain text: tags stripped, entities decoded, whitespace collapsed
+};
+
+// Tags removed, common entities decoded and whitespace runs folded to one space
+std::string plain_text(std::string_view html);
+
+// Writes docs.store (layout in index_format.hpp). Records are buffered into a
+// raw block that is compressed once it reaches docstore::kBlockSize.
+class DocStoreWriter {
+public:
+    bool open(const std::string &path);
+    // Ids must ascend; doc.text is stored as plain_text(doc.text)
+    void add(const DocumentView &doc);
+    // Same with a body that is already plain text
+    void add(const StoredDoc &doc);
+    bool finish();
+
+private:
+    std::string path_;
+    std::ofstream out_;
+    uint64_t pos_{0};
+    std::string block_;
+    std::string compressed_;
+    std::vector<docstore::Block> blocks_;
+    std::vector<docstore::Entry> entries_;
+    uint64_t raw_bytes_{0};
+
+    void flush_block();
+    void add_record(uint64_t id, std::string_view source, std::string_view url, std::string_view title,
+                    std::string_view body);
+};
+
+// Read-only, mmapped docs.store. get() decompresses one block per call; the
+// last block each thread decoded is kept, so hits from one block decode once.
+class DocStore {
+public:
+    bool open(const std::string &path);
+    void close();
+    bool is_open() const { return file_.is_open(); }
+    size_t doc_count() const { return header_ ? header_->doc_count : 0; }
+
+    // False when doc_id is not stored or its block is corrupt
+    bool get(uint64_t doc_id, StoredDoc &doc) const;
+
+private:
+    MappedFile file_;
+    const docstore::Header *header_{nullptr};
+    const docstore::Block *blocks_{nullptr};
+    const docstore::Entry *entries_{nullptr};
+    uint64_t generation_{0};  // tells apart stores reopened at the same address
+
+    const std::string *raw_block(uint32_t block) const;
+};
@@ -0,0 +1,163 @@
+#include "export.hpp"
+#include "buffered_writer.hpp"
+#include "zipf.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+
+namespace {
+// Below this many records per thread a parallel sort is not worth its threads
+constexpr size_t kMinSortChunk = 1 << 16;
+
+bool ranks_before(const RankedTerm &a, const RankedTerm &b) {
+    if (a.cf != b.cf) return a.cf > b.cf;
+    return a.term < b.term;
+}
+
+// Sorts equal chunks concurrently, then merges neighbouring runs in rounds
+void parallel_sort(std::vector<RankedTerm> &items, size_t threads) {
+    size_t chunks = std::min(std::max<size_t>(threads, 1), items.size() / kMinSortChunk);
+    if (chunks <= 1) {
+        std::sort(items.begin(), items.end(), ranks_before);
+        return;
+    }
+    std::vector<size_t> bounds;
+    for (size_t c = 0; c <= chunks; ++c) bounds.push_back(items.size() * c / chunks);
+    auto at = [&items](size_t i) { return items.begin() + static_cast<std::ptrdiff_t>(i); };
+
+    std::vector<std::thread> workers;
+    for (size_t c = 0; c < chunks; ++c) {
+        workers.emplace_back([&, c]() { std::sort(at(bounds[c]), at(bounds[c + 1]), ranks_before); });
+    }
+    for (auto &w : workers) w.join();
+    while (bounds.size() > 2) {
+        std::vector<size_t> merged;
+        workers.clear();
+        for (size_t c = 0; c + 1 < bounds.size(); c += 2) {
+            merged.push_back(bounds[c]);
+            if (c + 2 >= bounds.size()) break;
+            workers.emplace_back([&, c]() {
+                std::inplace_merge(at(bounds[c]), at(bounds[c + 1]), at(bounds[c + 2]), ranks_before);
+            });
+        }
+        for (auto &w : workers) w.join();
+        merged.push_back(bounds.back());
+        bounds = std::move(merged);
+    }
+}
+
+// Runs tasks on up to `threads` threads (inline for one); true if all succeed
+bool run_tasks(const std::vector<std::function<bool()>> &tasks, size_t threads) {
+    std::atomic<size_t> next{0};
+    std::atomic<bool> ok{true};
+    auto work = [&]() {
+        for (size_t i = next++; i < tasks.size(); i = next++) {
+            if (!tasks[i]()) ok = false;
+        }
+    };
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < std::min(std::max<size_t>(threads, 1), tasks.size()); ++t) workers.emplace_back(work);
+    work();
+    for (auto &w : workers) w.join();
+    return ok;
+}
+}
+
+std::vector<RankedTerm> rank_terms(const InvertedIndex &index, size_t threads) {
+    const auto &terms = index.terms();
+    std::vector<RankedTerm> ranked;
+    ranked.reserve(terms.size());
+    for (uint32_t id = 0; id < terms.size(); ++id) {
+        ranked.push_back({index.dictionary().term(id), terms[id].cf, terms[id].df});
+    }
+    parallel_sort(ranked, threads);
+    return ranked;
+}
+
+std::vector<RankedTerm> rank_terms(const std::vector<TermStats> &terms, size_t threads) {
+    std::vector<RankedTerm> ranked;
+    ranked.reserve(terms.size());
+    for (const auto &t : terms) ranked.push_back({t.term, t.cf, t.df});
+    parallel_sort(ranked, threads);
+    return ranked;
+}
+
+bool write_vocabulary_tsv(const std::string &path, const std::vector<RankedTerm> &ranked) {
+    BufferedWriter out;
+    if (!out.open(path)) return false;
+    out.put("rank\ttoken\tcf\tdf\n");
+    uint64_t rank = 0;
+    for (const auto &t : ranked) {
+        out.put_uint(++rank);
+        out.put('\t');
+        out.put(t.term);
+        out.put('\t');
+        out.put_uint(t.cf);
+        out.put('\t');
+        out.put_uint(t.df);
+        out.put('\n');
+    }
+    return out.close();
+}
+
+bool write_inverted_index_tsv(const std::string &path, const InvertedIndex &index) {
+    BufferedWriter out;
+    if (!out.open(path)) return false;
+    out.put("token\tdoc_id\ttf\n");
+    for (uint32_t id : index.sorted_term_ids()) {
+        std::string_view tok = index.dictionary().term(id);
+        for (PostingIterator it(index.terms()[id].postings.view()); it.valid(); it.next()) {
+            out.put(tok);
+            out.put('\t');
+            out.put_uint(it.doc());
+            out.put('\t');
+            out.put_uint(it.tf());
+            out.put('\n');
+        }
+    }
+    return out.close();
+}
+
+bool write_docmap_tsv(const std::string &path, size_t doc_count, const DocMetadata &docs) {
+    BufferedWriter out;
+    if (!out.open(path)) return false;
+    out.put("doc_id\tsource\ttitle\turl\n");
+    Document doc;
+    for (size_t i = 0; i < doc_count; ++i) {
+        docs(i, doc);
+        out.put_uint(doc.id);
+        out.put('\t');
+        out.put(doc.source);
+        out.put('\t');
+        for (char c : doc.title) out.put(c == '\t' ? ' ' : c);
+        out.put('\t');
+        out.put(doc.url);
+        out.put('\n');
+    }
+    return out.close();
+}
+
+bool export_index(const InvertedIndex &index, const ExportPaths &paths, size_t threads, const DocStore *store) {
+    std::vector<RankedTerm> ranked = rank_terms(index, threads);
+    std::vector<std::function<bool()>> tasks;
+    // Slowest first, so the short files fill in around them
+    if (!paths.inverted_index.empty()) {
+        tasks.push_back([&]() { return write_inverted_index_tsv(paths.inverted_index, index); });
+    }
+    if (!paths.binary.empty()) tasks.push_back([&]() { return index.save_binary(paths.binary, store); });
+    tasks.push_back([&]() { return write_vocabulary_tsv(paths.vocabulary, ranked); });
+    tasks.push_back([&]() { return write_zipf_tsv(paths.zipf, ranked); });
+    tasks.push_back([&]() { return write_docmap_tsv(paths.docmap, index.doc_count(), index.metadata(store)); });
+    return run_tasks(tasks, threads);
+}
+
+bool export_merged(const InvertedIndex &index, const std::vector<TermStats> &vocab, const ExportPaths &paths,
+                   size_t threads, const DocStore *store) {
+    std::vector<RankedTerm> ranked = rank_terms(vocab, threads);
+    return run_tasks({[&]() { return write_vocabulary_tsv(paths.vocabulary, ranked); },
+                      [&]() { return write_zipf_tsv(paths.zipf, ranked); },
+                      [&]() { return write_docmap_tsv(paths.docmap, index.doc_count(), index.metadata(store)); }},
+                     threads);
+}
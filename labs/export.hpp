@@ -0,0 +1,44 @@
+#pragma once
+
+#include "index.hpp"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Vocabulary entry in rank order; term points into the index dictionary (or
+// the TermStats it was ranked from)
+struct RankedTerm {
+    std::string_view term;
+    uint64_t cf;
+    uint32_t df;
+};
+
+// Terms by descending cf, then term bytes: the rank order shared by
+// vocabulary.tsv and zipf.tsv. Sorted in chunks on up to `threads` threads.
+std::vector<RankedTerm> rank_terms(const InvertedIndex &index, size_t threads = 1);
+std::vector<RankedTerm> rank_terms(const std::vector<TermStats> &terms, size_t threads = 1);
+
+// rank/token/cf/df
+bool write_vocabulary_tsv(const std::string &path, const std::vector<RankedTerm> &ranked);
+// token/doc_id/tf, terms in byte order
+bool write_inverted_index_tsv(const std::string &path, const InvertedIndex &index);
+// doc_id/source/title/url; tabs in titles become spaces
+bool write_docmap_tsv(const std::string &path, size_t doc_count, const DocMetadata &docs);
+
+struct ExportPaths {
+    std::string vocabulary;
+    std::string inverted_index;  // skipped when empty
+    std::string docmap;
+    std::string zipf;
+    std::string binary;          // skipped when empty
+};
+
+// Writes the outputs of a build, ranking the vocabulary once. With threads > 1
+// the files are written concurrently, one per thread. Doc metadata comes from
+// store when the index kept ids only (see InvertedIndex::set_doc_store).
+bool export_index(const InvertedIndex &index, const ExportPaths &paths, size_t threads = 1,
+                  const DocStore *store = nullptr);
+// Same after a SPIMI merge, which already wrote index.bin and inverted_index.tsv
+bool export_merged(const InvertedIndex &index, const std::vector<TermStats> &vocab, const ExportPaths &paths,
+                   size_t threads = 1, const DocStore *store = nullptr);
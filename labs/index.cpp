@@ -1,184 +1,301 @@
 #include "index.hpp"
+#include "metrics.hpp"
+#include "segment_writer.hpp"
+#include "spimi.hpp"
 
 #include <algorithm>
-#include <cctype>
-#include <fstream>
 #include <iostream>
-#include <sstream>
 
 namespace {
-std::string trim(const std::string &s) {
-    size_t start = 0;
-    while (start < s.size() && std::isspace(static_cast<unsigned char>(s[start]))) ++start;
-    size_t end = s.size();
-    while (end > start && std::isspace(static_cast<unsigned char>(s[end - 1]))) --end;
-    return s.substr(start, end - start);
+Document metadata_of(const DocumentView &doc) {
+    Document meta;
+    meta.id = doc.id;
+    meta.source.assign(doc.source.data(), doc.source.size());
+    meta.url.assign(doc.url.data(), doc.url.size());
+    meta.title.assign(doc.title.data(), doc.title.size());
+    return meta;
 }
-
-std::vector<std::string> split(const std::string &s, char delim) {
-    std::vector<std::string> parts;
-    std::stringstream ss(s);
-    std::string item;
-    while (std::getline(ss, item, delim)) {
-        parts.push_back(item);
-    }
-    return parts;
 }
 
-std::string normalize_term(const std::string &s) {
-    std::string out;
-    out.reserve(s.size());
-    for (unsigned char c : s) {
-        if (c >= 'A' && c <= 'Z') out.push_back(static_cast<char>(c + 32));
-        else out.push_back(static_cast<char>(c));
+// Tokens are already folded, so stemming alone gives normalize_term()'s result.
+// Several surface forms can stem to one term; they share one posting.
+const std::vector<uint32_t> &DocTermFolder::fold(const TermCounter &counter, TermDictionary &dict) {
+    bool with_positions = counter.record_positions();
+    for (uint32_t id : touched_) {
+        tf_[id] = 0;
+        if (with_positions) positions_[id].clear();
     }
-    return stem_word(out);
-}
+    touched_.clear();
+    for (uint32_t local = 0; local < counter.size(); ++local) {
+        uint32_t id = dict.intern(stem_view(counter.term(local)));
+        if (id >= tf_.size()) tf_.resize(std::max<size_t>(id + 1, tf_.size() * 2), 0);
+        if (tf_[id] == 0) touched_.push_back(id);
+        tf_[id] += counter.count(local);
+        if (with_positions) {
+            if (id >= positions_.size()) positions_.resize(tf_.size());
+            const auto &pos = counter.positions(local);
+            positions_[id].insert(positions_[id].end(), pos.begin(), pos.end());
+        }
+    }
+    if (with_positions) {
+        for (uint32_t id : touched_) {
+            auto &pos = positions_[id];
+            if (!std::is_sorted(pos.begin(), pos.end())) std::sort(pos.begin(), pos.end());
+        }
+    }
+    return touched_;
 }
 
 void InvertedIndex::add_document(const Document &doc) {
-    std::unordered_map<std::string, uint32_t> freqs;
-    tokenize_document(doc, freqs, stats_);
-    Document meta = doc;
-    meta.text.clear(); // free heavy text to keep memory low
-    docs_.push_back(std::move(meta));
-
-    for (const auto &kv : freqs) {
-        std::string term = normalize_term(kv.first);
-        auto &info = index_[term];
-        info.cf += kv.second;
-        info.df += 1;
-        info.postings.push_back({doc.id, kv.second});
-    }
-}
-
-std::vector<SearchHit> InvertedIndex::search(const std::string &query) const {
-    std::vector<std::string> raw_groups = split(query, '|');
-    std::unordered_set<uint64_t> final_set;
-    bool first_group = true;
-
-    for (const auto &raw_group : raw_groups) {
-        std::vector<std::string> terms_raw = split(raw_group, '&');
-        std::vector<std::string> terms;
-        for (const auto &t : terms_raw) {
-            std::string trimmed = trim(t);
-            if (!trimmed.empty()) terms.push_back(normalize_term(trimmed));
-        }
-        if (terms.empty()) continue;
-
-        std::unordered_set<uint64_t> group_set;
-        bool first_term = true;
-        for (const auto &term : terms) {
-            auto it = index_.find(term);
-            if (it == index_.end()) {
-                group_set.clear();
-                break;
-            }
-            std::unordered_set<uint64_t> term_set;
-            term_set.reserve(it->second.postings.size());
-            for (const auto &p : it->second.postings) term_set.insert(p.doc_id);
-
-            if (first_term) {
-                group_set = std::move(term_set);
-                first_term = false;
-            } else {
-                std::unordered_set<uint64_t> intersect;
-                intersect.reserve(std::min(group_set.size(), term_set.size()));
-                for (auto id : group_set) {
-                    if (term_set.find(id) != term_set.end()) intersect.insert(id);
-                }
-                group_set = std::move(intersect);
-            }
-
-            if (group_set.empty()) break;
-        }
+    add_document(DocumentView{doc.id, doc.source, doc.url, doc.title, doc.text});
+}
 
-        if (group_set.empty()) continue;
+void InvertedIndex::add_document(const DocumentView &doc) {
+    counter_.clear();
+    uint64_t tokens_before = stats_.tokens;
+    tokenize_document(doc.text, counter_, stats_);
+    // Lengths are kept per id slot, so callers that skip ids still look up the right doc
+    if (!docs_.empty() && doc.id > docs_.front().id + doc_lengths_.size()) {
+        doc_lengths_.resize(doc.id - docs_.front().id, 0);
+    }
+    if (store_) {
+        store_->add(doc);
+        docs_.push_back(Document{doc.id, {}, {}, {}, {}});
+    } else {
+        docs_.push_back(metadata_of(doc)); // heavy text is never copied
+    }
+    doc_lengths_.push_back(static_cast<uint32_t>(stats_.tokens - tokens_before));
+    total_length_ += doc_lengths_.back();
 
-        if (first_group) {
-            final_set = std::move(group_set);
-            first_group = false;
-        } else {
-            final_set.insert(group_set.begin(), group_set.end());
+    size_t known = dict_.size();
+    const std::vector<uint32_t> *ids;
+    {
+        StageTimer timer(Stage::Stem);
+        ids = &folder_.fold(counter_, dict_);
+    }
+    if (dict_.size() > known) terms_.resize(dict_.size());
+    bool positional = counter_.record_positions();
+    {
+        StageTimer timer(Stage::Insert);
+        for (uint32_t id : *ids) {
+            add_postings(id, doc.id, folder_.tf(id), positional ? folder_.positions(id).data() : nullptr);
         }
     }
+    add_counter(Counter::Postings, ids->size());
+    if (cache_) cache_->clear();
+    sorted_.reset();
+    maybe_flush();
+}
 
-    if (final_set.empty()) return {};
-
-    std::unordered_map<uint64_t, uint64_t> scores;
-    scores.reserve(final_set.size());
+void PartialIndex::add_document(const DocumentView &doc) {
+    counter_.set_record_positions(positional);
+    counter_.clear();
+    uint64_t tokens_before = stats.tokens;
+    tokenize_document(doc.text, counter_, stats);
+    if (store_docs) {
+        stored.push_back({doc.id, std::string(doc.source), std::string(doc.url), std::string(doc.title),
+                          plain_text(doc.text)});
+        docs.push_back(Document{doc.id, {}, {}, {}, {}});
+    } else {
+        docs.push_back(metadata_of(doc));
+    }
+    doc_lengths.push_back(static_cast<uint32_t>(stats.tokens - tokens_before));
+    uint64_t local_id = docs.size();
 
-    // Collect unique terms once
-    std::unordered_set<std::string> unique_terms;
-    for (const auto &raw_group : raw_groups) {
-        for (const auto &t : split(raw_group, '&')) {
-            std::string trimmed = trim(t);
-            if (!trimmed.empty()) unique_terms.insert(normalize_term(trimmed));
+    const std::vector<uint32_t> *ids;
+    {
+        StageTimer timer(Stage::Stem);
+        ids = &folder_.fold(counter_, dict);
+    }
+    StageTimer timer(Stage::Insert);
+    postings.resize(dict.size());
+    if (positional) positions.resize(dict.size());
+    for (uint32_t id : *ids) {
+        postings[id].push_back({local_id, folder_.tf(id)});
+        if (positional) {
+            const auto &pos = folder_.positions(id);
+            positions[id].insert(positions[id].end(), pos.begin(), pos.end());
         }
     }
+    add_counter(Counter::Postings, ids->size());
+}
 
-    for (const auto &term : unique_terms) {
-        auto it = index_.find(term);
-        if (it == index_.end()) continue;
-        for (const auto &p : it->second.postings) {
-            if (final_set.find(p.doc_id) != final_set.end()) {
-                scores[p.doc_id] += p.tf;
-            }
+void InvertedIndex::merge(PartialIndex &&part) {
+    StageTimer timer(Stage::Insert);
+    // Part ids continue after the last length slot, which is the last id even when ids were skipped
+    uint64_t base = docs_.empty() ? 0 : docs_.front().id - 1 + doc_lengths_.size();
+    for (size_t i = 0; i < part.docs.size(); ++i) {
+        part.docs[i].id = base + i + 1;
+        docs_.push_back(std::move(part.docs[i]));
+    }
+    if (store_) {
+        for (size_t i = 0; i < part.stored.size(); ++i) {
+            part.stored[i].id = base + i + 1;
+            store_->add(part.stored[i]);
         }
     }
-
-    std::vector<SearchHit> hits;
-    hits.reserve(final_set.size());
-    for (auto id : final_set) {
-        hits.push_back({id, scores[id]});
+    for (uint32_t len : part.doc_lengths) {
+        doc_lengths_.push_back(len);
+        total_length_ += len;
     }
+    for (uint32_t local = 0; local < part.postings.size(); ++local) {
+        uint32_t id = intern(part.dict.term(local));
+        const uint32_t *pos = part.positional ? part.positions[local].data() : nullptr;
+        for (const auto &p : part.postings[local]) {
+            add_postings(id, base + p.doc_id, p.tf, pos);
+            if (pos) pos += p.tf;
+        }
+    }
+    stats_.docs += part.stats.docs;
+    stats_.tokens += part.stats.tokens;
+    stats_.token_chars += part.stats.token_chars;
+    stats_.bytes_in += part.stats.bytes_in;
+    if (cache_) cache_->clear();
+    sorted_.reset();
+    maybe_flush();
+}
 
-    std::sort(hits.begin(), hits.end(), [](const SearchHit &a, const SearchHit &b) {
-        if (a.score != b.score) return a.score > b.score;
-        return a.doc_id < b.doc_id;
-    });
+uint32_t InvertedIndex::intern(std::string_view term) {
+    uint32_t id = dict_.intern(term);
+    if (id == terms_.size()) terms_.emplace_back();
+    return id;
+}
 
-    return hits;
+void InvertedIndex::set_positional(bool on) {
+    counter_.set_record_positions(on);
 }
 
-void InvertedIndex::save_vocabulary(const std::string &path) const {
-    std::vector<std::pair<std::string, TokenInfo>> items(index_.begin(), index_.end());
-    std::sort(items.begin(), items.end(), [](const auto &a, const auto &b) {
-        if (a.second.cf != b.second.cf) return a.second.cf > b.second.cf;
-        return a.first < b.first;
-    });
+void InvertedIndex::add_postings(uint32_t id, uint64_t doc_id, uint32_t tf, const uint32_t *positions) {
+    auto &info = terms_[id];
+    // Rough heap footprint: new terms cost their TokenInfo, key and table slots
+    if (info.df == 0) approx_bytes_ += sizeof(TokenInfo) + dict_.term(id).size() + 24;
+    size_t before = info.postings.byte_size();
+    info.cf += tf;
+    info.df += 1;
+    info.postings.push_back(doc_id, tf, positions);
+    approx_bytes_ += info.postings.byte_size() - before;
+}
+
+void InvertedIndex::set_memory_budget(size_t budget_bytes, const std::string &run_dir) {
+    memory_budget_ = budget_bytes;
+    run_dir_ = run_dir;
+}
+
+void InvertedIndex::maybe_flush() {
+    if (memory_budget_ && approx_bytes_ >= memory_budget_) flush_run();
+}
+
+void InvertedIndex::flush_run() {
+    if (dict_.empty()) return;
+    StageTimer timer(Stage::Flush);
+    std::string path = run_dir_ + "/run_" + std::to_string(runs_.size()) + ".bin";
+    if (!write_run(path, *this)) return;
+    runs_.push_back(path);
+    if (cache_) cache_->clear();
+    sorted_.reset();
+    dict_.clear();
+    terms_.clear();
+    terms_.shrink_to_fit();
+    approx_bytes_ = 0;
+}
+
+const TokenInfo *InvertedIndex::find(std::string_view term) const {
+    uint32_t id = dict_.find(term);
+    return id == TermDictionary::kNoTerm ? nullptr : &terms_[id];
+}
+
+std::shared_ptr<const InvertedIndex::SortedTerms> InvertedIndex::sorted_terms() const {
+    std::lock_guard<std::mutex> lock(*sorted_mu_);
+    if (sorted_) return sorted_;
+    std::vector<uint32_t> ids(dict_.size());
+    for (uint32_t i = 0; i < ids.size(); ++i) ids[i] = i;
+    std::sort(ids.begin(), ids.end(), [this](uint32_t a, uint32_t b) { return dict_.term(a) < dict_.term(b); });
+    std::vector<std::string_view> terms;
+    terms.reserve(ids.size());
+    for (uint32_t id : ids) terms.push_back(dict_.term(id));
+    sorted_ = std::make_shared<const SortedTerms>(SortedTerms{SortedTermDict(terms), std::move(ids)});
+    return sorted_;
+}
+
+std::vector<uint32_t> InvertedIndex::sorted_term_ids() const {
+    return sorted_terms()->ids;
+}
 
-    std::ofstream out(path);
-    out << "rank\ttoken\tcf\tdf\n";
-    size_t rank = 0;
-    for (const auto &kv : items) {
-        ++rank;
-        out << rank << '\t' << kv.first << '\t' << kv.second.cf << '\t' << kv.second.df << '\n';
+std::shared_ptr<const PostingList> InvertedIndex::pattern_postings(const std::string &pattern) const {
+    PatternCache *cache = cache_ && cache_->patterns.enabled() ? &cache_->patterns : nullptr;
+    if (cache) {
+        if (auto hit = cache->find(pattern)) return hit;
     }
+    auto sorted = sorted_terms();
+    std::string_view prefix = pattern_prefix(pattern);
+    std::vector<PostingListView> matches;
+    sorted->dict.scan(sorted->dict.lower_bound(prefix), [&](uint32_t rank, std::string_view term) {
+        if (term.substr(0, prefix.size()) != prefix) return false;
+        if (match_term_pattern(pattern, term)) matches.push_back(terms_[sorted->ids[rank]].postings.view());
+        return true;
+    });
+    auto list = std::make_shared<const PostingList>(merge_pattern_postings(std::move(matches)));
+    if (cache) cache->insert(pattern, list, list->byte_size());
+    return list;
 }
 
-void InvertedIndex::save_inverted_index(const std::string &path) const {
-    std::vector<std::string> tokens;
-    tokens.reserve(index_.size());
-    for (const auto &kv : index_) tokens.push_back(kv.first);
-    std::sort(tokens.begin(), tokens.end());
+std::vector<SearchHit> InvertedIndex::search(const std::string &query, size_t k, const DocBitmap *deleted,
+                                             const Scorer *scorer) const {
+    if (cache_ && !deleted && !scorer) {
+        return cached_search(query, k, cache_->results, [&](const QueryNode &root) { return search(root, k); });
+    }
+    return search(simplify_query(parse_query(query)), k, deleted, scorer);
+}
 
-    std::ofstream out(path);
-    out << "token\tdoc_id\ttf\n";
-    for (const auto &tok : tokens) {
-        const auto &info = index_.at(tok);
-        for (const auto &p : info.postings) {
-            out << tok << '\t' << p.doc_id << '\t' << p.tf << '\n';
-        }
+std::vector<SearchHit> InvertedIndex::search(const QueryNode &root, size_t k, const DocBitmap *deleted,
+                                             const Scorer *scorer) const {
+    Scorer own;
+    if (!scorer) {
+        own = Scorer(ranking_, collection_stats(), doc_lengths());
+        scorer = &own;
     }
+    return run_query_tree(root, [this](const std::string &term) -> PostingListView {
+        const TokenInfo *info = find(term);
+        return info ? info->postings.view() : PostingListView{};
+    }, k, deleted, scorer, cache_ ? &cache_->pairs : nullptr,
+                          [this](const std::string &pattern) { return pattern_postings(pattern); },
+                          cache_ ? &cache_->doc_sets : nullptr);
+}
+
+void InvertedIndex::set_ranking(const RankingParams &params) {
+    ranking_ = params;
+    if (cache_) cache_->clear();
+}
+
+void InvertedIndex::set_cache_capacity(size_t result_bytes, size_t pair_bytes) {
+    if (result_bytes || pair_bytes) cache_ = std::make_unique<QueryCache>(result_bytes, pair_bytes);
+    else cache_.reset();
+}
+
+DocLengthsView InvertedIndex::doc_lengths() const {
+    if (docs_.empty()) return {};
+    return {doc_lengths_.data(), docs_.front().id, doc_lengths_.size()};
+}
+
+DocMetadata InvertedIndex::metadata(const DocStore *store) const {
+    if (!store) return [this](size_t i, Document &meta) { meta = docs_[i]; };
+    return [this, store](size_t i, Document &meta) {
+        StoredDoc doc;
+        meta.id = docs_[i].id;
+        if (!store->get(meta.id, doc)) doc = StoredDoc{};
+        meta.source = std::move(doc.source);
+        meta.url = std::move(doc.url);
+        meta.title = std::move(doc.title);
+    };
 }
 
-void InvertedIndex::save_docmap(const std::string &path) const {
-    std::ofstream out(path);
-    out << "doc_id\tsource\ttitle\turl\n";
-    for (const auto &doc : docs_) {
-        std::string safe_title = doc.title;
-        std::replace(safe_title.begin(), safe_title.end(), '\t', ' ');
-        out << doc.id << '\t' << doc.source << '\t' << safe_title << '\t' << doc.url << '\n';
+bool InvertedIndex::save_binary(const std::string &path, const DocStore *store) const {
+    StageTimer timer(Stage::Flush);
+    SegmentWriter writer;
+    if (!writer.open(path)) return false;
+    for (uint32_t id : sorted_term_ids()) {
+        const TokenInfo &info = terms_[id];
+        writer.add_term(dict_.term(id), info.cf, info.df, info.postings);
     }
+    return writer.finish(docs_.size(), metadata(store), doc_lengths_, stats_);
 }
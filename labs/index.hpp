@@ -1,47 +1,151 @@
 #pragma once
 
+#include "doc_store.hpp"
+#include "postings.hpp"
+#include "query.hpp"
 #include "stemmer.hpp"
+#include "term_dict.hpp"
 #include "tokenizer.hpp"
 
+#include <memory>
+#include <mutex>
 #include <string>
-#include <unordered_map>
-#include <unordered_set>
 #include <vector>
 
-struct Posting {
-    uint64_t doc_id;
-    uint32_t tf;
-};
-
 struct TokenInfo {
     uint64_t cf{0};
     uint32_t df{0};
-    std::vector<Posting> postings;
+    PostingList postings;
+};
+
+struct TermStats {
+    std::string term;
+    uint64_t cf;
+    uint32_t df;
+};
+
+// Stems the surface forms counted for one document and sums their counts per
+// interned term id. Buffers are reused across documents.
+class DocTermFolder {
+public:
+    // Returns the ids touched by this document; tf(id) is valid until the next fold()
+    const std::vector<uint32_t> &fold(const TermCounter &counter, TermDictionary &dict);
+    uint32_t tf(uint32_t id) const { return tf_[id]; }
+    // Merged ascending positions of id's forms, when the counter recorded them
+    const std::vector<uint32_t> &positions(uint32_t id) const { return positions_[id]; }
+
+private:
+    std::vector<uint32_t> tf_;
+    std::vector<std::vector<uint32_t>> positions_;
+    std::vector<uint32_t> touched_;
 };
 
-struct SearchHit {
-    uint64_t doc_id;
-    uint64_t score;
+// Index of a contiguous run of documents built off-thread; doc ids are local (1..docs.size())
+struct PartialIndex {
+    bool positional{false};  // set before the first add_document
+    std::vector<Document> docs;
+    TermDictionary dict;
+    std::vector<std::vector<Posting>> postings;  // by dict id
+    std::vector<std::vector<uint32_t>> positions;  // by dict id, tf entries per posting when positional
+    std::vector<uint32_t> doc_lengths;           // tokens per doc, parallel to docs
+    bool store_docs{false};                      // set before the first add_document
+    std::vector<StoredDoc> stored;               // with store_docs; docs then hold ids only
+    TokenizationStats stats;
+
+    void add_document(const DocumentView &doc);
+
+private:
+    TermCounter counter_;
+    DocTermFolder folder_;
 };
 
 class InvertedIndex {
 public:
+    // Positional indexes keep token positions for phrase and NEAR/k queries;
+    // switch on before the first document
+    void set_positional(bool on);
+    bool positional() const { return counter_.record_positions(); }
+
     void add_document(const Document &doc);
-    std::vector<SearchHit> search(const std::string &query) const;
+    void add_document(const DocumentView &doc);
+    // While set, added docs go to store and docs() keeps only their ids, so no
+    // per-doc strings stay in memory; set before the first document
+    void set_doc_store(DocStoreWriter *store) { store_ = store; }
+    bool stores_docs() const { return store_ != nullptr; }
+    // Appends a partial index after the current documents, renumbering its doc ids
+    void merge(PartialIndex &&part);
+    // k == 0 returns every match, otherwise the k best
+    // Scores with the index's own ranking unless a scorer is given
+    // Plain searches (no deleted, no scorer) go through the result cache once enabled
+    std::vector<SearchHit> search(const std::string &query, size_t k = 0, const DocBitmap *deleted = nullptr,
+                                  const Scorer *scorer = nullptr) const;
+    std::vector<SearchHit> search(const QueryNode &root, size_t k = 0, const DocBitmap *deleted = nullptr,
+                                  const Scorer *scorer = nullptr) const;
+    void set_ranking(const RankingParams &params);
+    // Zero for both disables caching. Cleared by every change to documents or ranking
+    void set_cache_capacity(size_t result_bytes, size_t pair_bytes);
+    const QueryCache *cache() const { return cache_.get(); }
+    const RankingParams &ranking() const { return ranking_; }
+
+    // Bounded-memory (SPIMI) build: once the in-memory postings exceed budget_bytes
+    // they are flushed as a sorted run file into run_dir; see spimi.hpp for the merge
+    void set_memory_budget(size_t budget_bytes, const std::string &run_dir);
+    void flush_run();
+    const std::vector<std::string> &runs() const { return runs_; }
 
-    size_t vocab_size() const { return index_.size(); }
+    size_t vocab_size() const { return dict_.size(); }
     size_t doc_count() const { return docs_.size(); }
     const TokenizationStats &stats() const { return stats_; }
+    CollectionStats collection_stats() const { return {docs_.size(), total_length_}; }
+    // Valid until the next add_document or merge
+    DocLengthsView doc_lengths() const;
 
-    void save_vocabulary(const std::string &path) const;
-    void save_inverted_index(const std::string &path) const;
-    void save_docmap(const std::string &path) const;
+    // Metadata of docs(), read back from the finished store when the index kept ids only
+    DocMetadata metadata(const DocStore *store = nullptr) const;
 
-    const std::unordered_map<std::string, TokenInfo> &tokens() const { return index_; }
+    // Versioned binary segment readable by MappedIndex; the TSV outputs live in export.hpp
+    bool save_binary(const std::string &path, const DocStore *store = nullptr) const;
+
+    const TermDictionary &dictionary() const { return dict_; }
+    // TokenInfo by dictionary id
+    const std::vector<TokenInfo> &terms() const { return terms_; }
+    const TokenInfo *find(std::string_view term) const;
+    // Dictionary ids ordered by term bytes
+    std::vector<uint32_t> sorted_term_ids() const;
+    // Union of the postings of the terms matching a pattern (see PatternLookup)
+    std::shared_ptr<const PostingList> pattern_postings(const std::string &pattern) const;
     const std::vector<Document> &docs() const { return docs_; }
+    // Indexed by doc id - first doc id, 0 for ids that were skipped
+    const std::vector<uint32_t> &doc_length_array() const { return doc_lengths_; }
 
 private:
-    std::unordered_map<std::string, TokenInfo> index_;
+    TermDictionary dict_;
+    std::vector<TokenInfo> terms_;
     std::vector<Document> docs_;
+    std::vector<uint32_t> doc_lengths_;
+    uint64_t total_length_{0};
+    DocStoreWriter *store_{nullptr};
+    RankingParams ranking_;
+    std::unique_ptr<QueryCache> cache_;
+    TermCounter counter_;
+    DocTermFolder folder_;
     TokenizationStats stats_;
+
+    // Byte-ordered view of dict_, built on first use and dropped by every change
+    struct SortedTerms {
+        SortedTermDict dict;
+        std::vector<uint32_t> ids;  // dictionary id by rank
+    };
+    std::unique_ptr<std::mutex> sorted_mu_{std::make_unique<std::mutex>()};  // keeps the index movable
+    mutable std::shared_ptr<const SortedTerms> sorted_;
+
+    size_t memory_budget_{0};
+    size_t approx_bytes_{0};
+    std::string run_dir_;
+    std::vector<std::string> runs_;
+
+    uint32_t intern(std::string_view term);
+    void add_postings(uint32_t id, uint64_t doc_id, uint32_t tf, const uint32_t *positions = nullptr);
+    void maybe_flush();
+    std::shared_ptr<const SortedTerms> sorted_terms() const;
 };
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+
+// On-disk segment layout (little-endian, every section 8-byte aligned):
+//   SegmentHeader
+//   TermEntry[term_count]     sorted by term bytes
+//   term strings              concatenated, no terminators
+//   PostingSkip[]             per-block skip entries of every term
+//   uint64_t[]                positions offset per block (positional segments)
+//   posting bytes             varint-encoded blocks (see postings.hpp)
+//   position bytes            positions side stream (positional segments)
+//   DocEntry[doc_count]       ordered by doc id
+//   uint32_t[]                token length per id from the first to the last
+//                             doc id, 0 for ids without a doc (merged deletes)
+//   doc strings               source + url + title per document
+namespace segment {
+
+constexpr char kMagic[8] = {'I', 'X', 'S', 'E', 'G', 'M', 'N', 'T'};
+constexpr uint32_t kVersion = 7;
+
+// SegmentHeader::flags
+constexpr uint32_t kFlagPositional = 1;
+
+struct SegmentHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t term_count;
+    uint64_t doc_count;
+    uint64_t terms_off;
+    uint64_t term_strings_off;
+    uint64_t skips_off;
+    uint64_t position_blocks_off;
+    uint64_t postings_off;
+    uint64_t positions_off;
+    uint64_t docs_off;
+    uint64_t doc_lengths_off;
+    uint64_t doc_strings_off;
+    uint64_t file_size;
+    // TokenizationStats of the build, kept so a loaded index can report them
+    uint64_t stat_docs;
+    uint64_t stat_tokens;
+    uint64_t stat_token_chars;
+    uint64_t stat_bytes_in;
+    uint64_t total_doc_length;
+};
+
+struct TermEntry {
+    uint64_t str_off;
+    uint32_t str_len;
+    uint32_t df;
+    uint64_t cf;
+    uint64_t skips_off;      // index into PostingSkip[]
+    uint64_t postings_off;   // byte offset into posting bytes
+    uint64_t postings_count;
+    uint64_t position_blocks_off;  // index into the per-block positions offsets
+    uint64_t positions_off;        // byte offset into position bytes
+};
+
+struct DocEntry {
+    uint64_t id;
+    uint64_t str_off;
+    uint32_t source_len;
+    uint32_t url_len;
+    uint32_t title_len;
+    uint32_t reserved;
+};
+
+inline uint64_t align8(uint64_t v) { return (v + 7) & ~uint64_t(7); }
+
+}
+
+// Document store layout (docs.store, little-endian):
+//   DocStoreHeader
+//   compressed blocks         back to back, see block_codec.hpp
+//   DocStoreBlock[block_count]   8-byte aligned
+//   DocStoreEntry[doc_count]     ordered by doc id
+// A raw block holds whole records: varint lengths of source, url, title and
+// body, then their bytes. Blocks are cut after kBlockSize raw bytes.
+namespace docstore {
+
+constexpr char kMagic[8] = {'I', 'X', 'D', 'O', 'C', 'S', 'T', 'R'};
+constexpr uint32_t kVersion = 1;
+constexpr uint32_t kBlockSize = 32 << 10;
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t doc_count;
+    uint64_t block_count;
+    uint64_t blocks_off;
+    uint64_t entries_off;
+    uint64_t raw_bytes;
+    uint64_t file_size;
+};
+
+struct Block {
+    uint64_t offset;          // file offset of the compressed bytes
+    uint32_t compressed_len;  // equal to raw_len: stored uncompressed
+    uint32_t raw_len;
+};
+
+struct Entry {
+    uint64_t id;
+    uint32_t block;
+    uint32_t offset;  // record start within the raw block
+};
+
+}
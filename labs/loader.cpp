@@ -1,10 +1,22 @@
 #include "loader.hpp"
+#include "mapped_file.hpp"
+#include "metrics.hpp"
 
 #include <cstdint>
-#include <fstream>
+#include <cstring>
 #include <iostream>
 
 namespace {
+enum Field { kSource, kUrl, kTitle, kRawHtml, kText, kContent, kFieldCount };
+
+int field_of(std::string_view key) {
+    static const std::string_view names[kFieldCount] = {"source", "url", "title", "raw_html", "text", "content"};
+    for (int f = 0; f < kFieldCount; ++f) {
+        if (key == names[f]) return f;
+    }
+    return -1;
+}
+
 char hex_to_char(char c) {
     if (c >= '0' && c <= '9') return c - '0';
     if (c >= 'a' && c <= 'f') return 10 + (c - 'a');
@@ -12,121 +24,250 @@ char hex_to_char(char c) {
     return 0;
 }
 
-std::string json_unescape(const std::string &line, size_t start) {
-    std::string out;
-    bool esc = false;
-    for (size_t i = start; i < line.size(); ++i) {
-        char c = line[i];
-        if (esc) {
-            switch (c) {
-                case '"': out.push_back('"'); break;
-                case '\\': out.push_back('\\'); break;
-                case '/': out.push_back('/'); break;
-                case 'b': out.push_back('\b'); break;
-                case 'f': out.push_back('\f'); break;
-                case 'n': out.push_back('\n'); break;
-                case 'r': out.push_back('\r'); break;
-                case 't': out.push_back('\t'); break;
-                case 'u': {
-                    if (i + 4 < line.size()) {
-                        char h1 = hex_to_char(line[i + 1]);
-                        char h2 = hex_to_char(line[i + 2]);
-                        char h3 = hex_to_char(line[i + 3]);
-                        char h4 = hex_to_char(line[i + 4]);
-                        uint16_t code = (h1 << 12) | (h2 << 8) | (h3 << 4) | h4;
-                        if (code < 0x80) {
-                            out.push_back(static_cast<char>(code));
-                        } else if (code < 0x800) {
-                            out.push_back(static_cast<char>(0xC0 | (code >> 6)));
-                            out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
-                        } else {
-                            out.push_back(static_cast<char>(0xE0 | (code >> 12)));
-                            out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
-                            out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
-                        }
-                        i += 4;
+uint32_t read_hex4(const char *p) {
+    return (hex_to_char(p[0]) << 12) | (hex_to_char(p[1]) << 8) | (hex_to_char(p[2]) << 4) | hex_to_char(p[3]);
+}
+
+void append_utf8(std::string &out, uint32_t code) {
+    if (code < 0x80) {
+        out.push_back(static_cast<char>(code));
+    } else if (code < 0x800) {
+        out.push_back(static_cast<char>(0xC0 | (code >> 6)));
+        out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+    } else if (code < 0x10000) {
+        out.push_back(static_cast<char>(0xE0 | (code >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+    } else {
+        out.push_back(static_cast<char>(0xF0 | (code >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+    }
+}
+
+// raw is the string body between the quotes, escapes still in place
+void json_unescape(std::string_view raw, std::string &out) {
+    out.clear();
+    out.reserve(raw.size());
+    size_t i = 0;
+    while (i < raw.size()) {
+        const char *bs = static_cast<const char *>(std::memchr(raw.data() + i, '\\', raw.size() - i));
+        size_t stop = bs ? static_cast<size_t>(bs - raw.data()) : raw.size();
+        out.append(raw.data() + i, stop - i);
+        i = stop;
+        if (i + 1 >= raw.size()) break;
+        char c = raw[i + 1];
+        i += 2;
+        switch (c) {
+            case 'b': out.push_back('\b'); break;
+            case 'f': out.push_back('\f'); break;
+            case 'n': out.push_back('\n'); break;
+            case 'r': out.push_back('\r'); break;
+            case 't': out.push_back('\t'); break;
+            case 'u': {
+                if (i + 4 > raw.size()) return;
+                uint32_t code = read_hex4(raw.data() + i);
+                i += 4;
+                if (code >= 0xD800 && code < 0xDC00 && i + 6 <= raw.size() && raw[i] == '\\' && raw[i + 1] == 'u') {
+                    uint32_t low = read_hex4(raw.data() + i + 2);
+                    if (low >= 0xDC00 && low < 0xE000) {
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                        i += 6;
                     }
-                    break;
                 }
-                default:
-                    out.push_back(c);
-                    break;
+                append_utf8(out, code);
+                break;
             }
-            esc = false;
-        } else if (c == '\\') {
-            esc = true;
-        } else if (c == '"') {
-            break;
-        } else {
-            out.push_back(c);
+            default:
+                // '"', '\\', '/' and anything unexpected map to themselves
+                out.push_back(c);
+                break;
         }
     }
-    return out;
 }
 
-bool extract_field(const std::string &line, const std::string &key, std::string &out) {
-    const std::string needle = "\"" + key + "\"";
-    size_t pos = line.find(needle);
-    if (pos == std::string::npos) return false;
-    pos = line.find('"', pos + needle.size());
-    if (pos == std::string::npos) return false;
-    out = json_unescape(line, pos + 1);
-    return true;
+size_t skip_ws(std::string_view s, size_t i) {
+    while (i < s.size() && (s[i] == ' ' || s[i] == '\t' || s[i] == '\r' || s[i] == '\n')) ++i;
+    return i;
 }
+
+// i points just past the opening quote; returns the index of the closing quote
+size_t find_string_end(std::string_view s, size_t i, bool &escaped) {
+    escaped = false;
+    while (i < s.size()) {
+        char c = s[i];
+        if (c == '"') return i;
+        if (c == '\\') {
+            escaped = true;
+            i += 2;
+        } else {
+            ++i;
+        }
+    }
+    return s.size();
 }
 
-std::vector<Document> load_documents_from_ndjson(const std::string &path) {
-    std::ifstream in(path);
-    if (!in) {
-        std::cerr << "Cannot open input NDJSON: " << path << "\n";
-        return {};
+// Skips a non-string value (number, literal, nested object/array)
+size_t skip_value(std::string_view s, size_t i) {
+    int depth = 0;
+    bool escaped = false;
+    while (i < s.size()) {
+        char c = s[i];
+        if (c == '"') {
+            i = find_string_end(s, i + 1, escaped) + 1;
+            continue;
+        }
+        if (c == '{' || c == '[') {
+            ++depth;
+        } else if (c == '}' || c == ']') {
+            if (depth == 0) return i;
+            --depth;
+        } else if (c == ',' && depth == 0) {
+            return i;
+        }
+        ++i;
     }
+    return i;
+}
 
-    std::vector<Document> docs;
-    std::string line;
-    while (std::getline(in, line)) {
-        Document doc;
-        extract_field(line, "source", doc.source);
-        extract_field(line, "url", doc.url);
-        extract_field(line, "title", doc.title);
-        std::string body;
-        if (extract_field(line, "raw_html", body) || extract_field(line, "text", body) || extract_field(line, "content", body)) {
-            doc.text = body;
+// Walks the top-level fields of one JSON object, stopping at the first malformed
+// one. visit(key, value, is_string, escaped) gets string values without their
+// quotes and with escapes still in place, other values as raw text.
+template <typename Visit>
+void walk_object(std::string_view line, Visit visit) {
+    size_t i = skip_ws(line, 0);
+    if (i >= line.size() || line[i] != '{') return;
+    ++i;
+    bool escaped = false;
+    while (true) {
+        i = skip_ws(line, i);
+        if (i >= line.size() || line[i] != '"') break;
+        size_t key_end = find_string_end(line, i + 1, escaped);
+        std::string_view key = line.substr(i + 1, key_end - i - 1);
+        i = skip_ws(line, key_end + 1);
+        if (i >= line.size() || line[i] != ':') break;
+        i = skip_ws(line, i + 1);
+        if (i >= line.size()) break;
+
+        if (line[i] == '"') {
+            size_t end = find_string_end(line, i + 1, escaped);
+            visit(key, line.substr(i + 1, end - i - 1), true, escaped);
+            i = end + 1;
+        } else {
+            size_t end = skip_value(line, i);
+            std::string_view raw = line.substr(i, end - i);
+            while (!raw.empty() && (raw.back() == ' ' || raw.back() == '\t' || raw.back() == '\r')) raw.remove_suffix(1);
+            visit(key, raw, false, false);
+            i = end;
         }
-        if (doc.text.empty()) continue;
-        doc.id = docs.size() + 1;
-        if (doc.title.empty()) doc.title = doc.url;
-        docs.push_back(std::move(doc));
+        i = skip_ws(line, i);
+        if (i >= line.size() || line[i] != ',') break;
+        ++i;
     }
-    return docs;
 }
 
-void process_ndjson_stream(const std::string &path, const std::function<void(Document &&)> &consumer,
-                           size_t progress_every) {
-    std::ifstream in(path);
-    if (!in) {
+void copy_fields(const DocumentView &view, Document &doc) {
+    doc.source.assign(view.source.data(), view.source.size());
+    doc.url.assign(view.url.data(), view.url.size());
+    doc.title.assign(view.title.data(), view.title.size());
+    doc.text.assign(view.text.data(), view.text.size());
+}
+}
+
+bool NdjsonScanner::parse(std::string_view line, DocumentView &doc) {
+    StageTimer timer(Stage::Parse);
+    add_counter(Counter::InputBytes, line.size() + 1);
+    std::string_view values[kFieldCount];
+    bool found[kFieldCount] = {};
+
+    walk_object(line, [&](std::string_view key, std::string_view raw, bool is_string, bool escaped) {
+        int field = field_of(key);
+        if (!is_string || field < 0 || found[field]) return;
+        if (escaped) {
+            json_unescape(raw, scratch_[field]);
+            raw = scratch_[field];
+        }
+        values[field] = raw;
+        found[field] = true;
+    });
+
+    doc.source = values[kSource];
+    doc.url = values[kUrl];
+    doc.title = values[kTitle];
+    if (found[kRawHtml]) doc.text = values[kRawHtml];
+    else if (found[kText]) doc.text = values[kText];
+    else doc.text = values[kContent];
+    if (doc.text.empty()) return false;
+    if (doc.title.empty()) doc.title = doc.url;
+    return true;
+}
+
+bool parse_ndjson_line(const std::string &line, Document &doc) {
+    NdjsonScanner scanner;
+    DocumentView view;
+    if (!scanner.parse(line, view)) return false;
+    copy_fields(view, doc);
+    return true;
+}
+
+void for_each_json_field(std::string_view line,
+                         const std::function<void(std::string_view, std::string_view, bool)> &consumer) {
+    std::string unescaped;
+    walk_object(line, [&](std::string_view key, std::string_view raw, bool is_string, bool escaped) {
+        if (escaped) {
+            json_unescape(raw, unescaped);
+            raw = unescaped;
+        }
+        consumer(key, raw, is_string);
+    });
+}
+
+void for_each_line(std::string_view data, const std::function<void(std::string_view)> &consumer) {
+    size_t pos = 0;
+    while (pos < data.size()) {
+        const char *nl = static_cast<const char *>(std::memchr(data.data() + pos, '\n', data.size() - pos));
+        size_t end = nl ? static_cast<size_t>(nl - data.data()) : data.size();
+        consumer(data.substr(pos, end - pos));
+        pos = end + 1;
+    }
+}
+
+void process_ndjson_views(const std::string &path, const std::function<void(const DocumentView &)> &consumer,
+                          size_t progress_every) {
+    MappedFile file;
+    if (!file.open(path)) {
         std::cerr << "Cannot open input NDJSON: " << path << "\n";
         return;
     }
+    file.advise_sequential();
 
-    std::string line;
+    NdjsonScanner scanner;
     size_t counter = 0;
-    while (std::getline(in, line)) {
-        Document doc;
-        extract_field(line, "source", doc.source);
-        extract_field(line, "url", doc.url);
-        extract_field(line, "title", doc.title);
-        std::string body;
-        if (extract_field(line, "raw_html", body) || extract_field(line, "text", body) || extract_field(line, "content", body)) {
-            doc.text = body;
-        }
-        if (doc.text.empty()) continue;
+    for_each_line(file.view(), [&](std::string_view line) {
+        DocumentView doc;
+        if (!scanner.parse(line, doc)) return;
         counter += 1;
         doc.id = counter;
-        if (doc.title.empty()) doc.title = doc.url;
-        consumer(std::move(doc));
+        consumer(doc);
         if (progress_every && counter % progress_every == 0) {
             std::cout << "  [LOAD] processed " << counter << " documents" << std::endl;
         }
-    }
+    });
+}
+
+std::vector<Document> load_documents_from_ndjson(const std::string &path) {
+    std::vector<Document> docs;
+    process_ndjson_stream(path, [&](Document &&doc) { docs.push_back(std::move(doc)); }, 0);
+    return docs;
+}
+
+void process_ndjson_stream(const std::string &path, const std::function<void(Document &&)> &consumer,
+                           size_t progress_every) {
+    process_ndjson_views(path, [&](const DocumentView &view) {
+        Document doc;
+        doc.id = view.id;
+        copy_fields(view, doc);
+        consumer(std::move(doc));
+    }, progress_every);
 }
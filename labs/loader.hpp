@@ -3,11 +3,39 @@
 #include "tokenizer.hpp"
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <functional>
 
+// Single-pass field scanner for one NDJSON record. Field views point into the
+// line itself, or into scanner-owned buffers when a value contained escapes,
+// so they stay valid until the next parse() call. Keep one scanner per thread.
+class NdjsonScanner {
+public:
+    // Returns false when the record has no text body. doc.id is left untouched.
+    bool parse(std::string_view line, DocumentView &doc);
+
+private:
+    std::string scratch_[6];
+};
+
 std::vector<Document> load_documents_from_ndjson(const std::string &path);
 
+// Parses one NDJSON record; returns false when it has no text body. doc.id is left untouched.
+bool parse_ndjson_line(const std::string &line, Document &doc);
+
+// Calls consumer(key, value, is_string) for each top-level field of one JSON object.
+// String values arrive unescaped, anything else as raw JSON text.
+void for_each_json_field(std::string_view line,
+                         const std::function<void(std::string_view, std::string_view, bool)> &consumer);
+
+// Calls consumer for every line of a mapped NDJSON buffer (without the trailing '\n')
+void for_each_line(std::string_view data, const std::function<void(std::string_view)> &consumer);
+
+// mmaps the NDJSON and calls consumer with zero-copy views of each parsed doc
+void process_ndjson_views(const std::string &path, const std::function<void(const DocumentView &)> &consumer,
+                          size_t progress_every = 5000);
+
 // Stream NDJSON without keeping everything in memory; calls consumer for each parsed doc
 void process_ndjson_stream(const std::string &path, const std::function<void(Document &&)> &consumer,
 						   size_t progress_every = 5000);
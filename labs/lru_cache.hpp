@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+struct CacheCounters {
+    uint64_t hits{0};
+    uint64_t misses{0};
+    uint64_t evictions{0};
+    uint64_t entries{0};
+    uint64_t bytes{0};  // approximate
+};
+
+// String-keyed LRU of immutable values bounded by an approximate byte budget.
+// Keys hash to independently locked shards, each evicting within its share of
+// the budget, so concurrent lookups rarely contend. A zero budget stores nothing.
+template <typename Value>
+class ShardedLru {
+public:
+    using ValuePtr = std::shared_ptr<const Value>;
+    static constexpr size_t kShards = 16;
+
+    explicit ShardedLru(size_t max_bytes = 0) : shard_budget_(max_bytes / kShards) {}
+    ShardedLru(const ShardedLru &) = delete;
+    ShardedLru &operator=(const ShardedLru &) = delete;
+
+    bool enabled() const { return shard_budget_ > 0; }
+
+    // Null on a miss
+    ValuePtr find(std::string_view key) {
+        if (!enabled()) return nullptr;
+        Shard &shard = shard_of(key);
+        std::lock_guard<std::mutex> lock(shard.mu);
+        auto it = shard.index.find(key);
+        if (it == shard.index.end()) {
+            ++misses_;
+            return nullptr;
+        }
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        ++hits_;
+        return it->second->value;
+    }
+
+    // bytes is the footprint of value; entries above a shard's budget are not kept
+    void insert(std::string_view key, ValuePtr value, size_t bytes) {
+        bytes += key.size() + kEntryOverhead;
+        if (bytes > shard_budget_) return;
+        Shard &shard = shard_of(key);
+        std::lock_guard<std::mutex> lock(shard.mu);
+        auto it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            shard.bytes -= it->second->bytes;
+            it->second->value = std::move(value);
+            it->second->bytes = bytes;
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        } else {
+            shard.lru.push_front({std::string(key), std::move(value), bytes});
+            shard.index.emplace(shard.lru.front().key, shard.lru.begin());
+        }
+        shard.bytes += bytes;
+        while (shard.bytes > shard_budget_) {
+            Entry &last = shard.lru.back();
+            shard.bytes -= last.bytes;
+            shard.index.erase(last.key);
+            shard.lru.pop_back();
+            ++evictions_;
+        }
+    }
+
+    void clear() {
+        for (auto &shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard.mu);
+            shard.index.clear();
+            shard.lru.clear();
+            shard.bytes = 0;
+        }
+    }
+
+    CacheCounters counters() const {
+        CacheCounters c;
+        c.hits = hits_;
+        c.misses = misses_;
+        c.evictions = evictions_;
+        for (const auto &shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard.mu);
+            c.entries += shard.lru.size();
+            c.bytes += shard.bytes;
+        }
+        return c;
+    }
+
+private:
+    // List node, hash node and shared_ptr control block, roughly
+    static constexpr size_t kEntryOverhead = 96;
+
+    struct Entry {
+        std::string key;
+        ValuePtr value;
+        size_t bytes;
+    };
+    struct Shard {
+        mutable std::mutex mu;
+        std::list<Entry> lru;  // most recent first
+        std::unordered_map<std::string_view, typename std::list<Entry>::iterator> index;  // keys live in lru
+        size_t bytes{0};
+    };
+
+    Shard &shard_of(std::string_view key) { return shards_[std::hash<std::string_view>()(key) % kShards]; }
+
+    Shard shards_[kShards];
+    size_t shard_budget_;
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+    std::atomic<uint64_t> evictions_{0};
+};
@@ -1,26 +1,319 @@
+#include "batch_queries.hpp"
+#include "doc_store.hpp"
+#include "export.hpp"
 #include "index.hpp"
 #include "loader.hpp"
-#include "zipf.hpp"
+#include "mapped_index.hpp"
+#include "metrics.hpp"
+#include "parallel_indexer.hpp"
+#include "query_server.hpp"
+#include "segmented_index.hpp"
+#include "sharded_index.hpp"
+#include "snippet.hpp"
+#include "spimi.hpp"
 
 #include <filesystem>
 #include <iostream>
+#include <sstream>
+#include <thread>
+
+namespace {
+// "512M", "2G", "65536" -> bytes
+size_t parse_size(const std::string &s) {
+    size_t pos = 0;
+    size_t value = std::stoull(s, &pos);
+    if (pos < s.size()) {
+        switch (s[pos]) {
+            case 'k': case 'K': value <<= 10; break;
+            case 'm': case 'M': value <<= 20; break;
+            case 'g': case 'G': value <<= 30; break;
+            default: break;
+        }
+    }
+    return value;
+}
+
+void print_stats(const TokenizationStats &st, size_t vocab_size) {
+    std::cout << "\n[STATS]\n";
+    std::cout << "  Documents: " << st.docs << "\n";
+    std::cout << "  Tokens:    " << st.tokens << "\n";
+    std::cout << "  Unique:    " << vocab_size << "\n";
+    std::cout << "  Avg len:   " << (st.tokens ? (double)st.token_chars / st.tokens : 0.0) << "\n";
+    std::cout << "  Bytes in:  " << st.bytes_in << "\n";
+}
+
+void print_cache_stats(const CacheCounters &results, const CacheCounters &pairs) {
+    auto line = [](const char *name, const CacheCounters &c) {
+        std::cout << "  " << name << c.hits << " hits, " << c.misses << " misses, " << c.evictions << " evictions, "
+                  << c.entries << " entries, " << c.bytes << " bytes\n";
+    };
+    std::cout << "\n[CACHE]\n";
+    line("Results:   ", results);
+    line("Pairs:     ", pairs);
+}
+
+void print_cache_stats(const QueryCache *cache) {
+    if (cache) print_cache_stats(cache->results.counters(), cache->pairs.counters());
+}
+
+// --batch-queries over one index: terms are resolved once and scored with the index's ranking
+bool batch_over(const InvertedIndex &index, const BatchOptions &batch) {
+    Scorer scorer(index.ranking(), index.collection_stats(), index.doc_lengths());
+    return run_batch_queries(batch, [&index](const std::string &term) -> PostingListView {
+        const TokenInfo *info = index.find(term);
+        return info ? info->postings.view() : PostingListView{};
+    }, scorer, [&index](const std::string &pattern) { return index.pattern_postings(pattern); });
+}
+
+bool batch_over(const MappedIndex &index, const BatchOptions &batch) {
+    Scorer scorer(index.ranking(), index.collection_stats(), index.doc_lengths());
+    return run_batch_queries(batch, [&index](const std::string &term) { return index.postings(term); }, scorer,
+                             [&index](const std::string &pattern) { return index.pattern_postings(pattern); });
+}
+
+SnippetLookup snippets_from(const DocStore &store, const SnippetOptions &options) {
+    return [&store, options](const std::string &query, uint64_t id) {
+        StoredDoc doc;
+        if (!store.get(id, doc)) return std::string();
+        return make_snippet(doc.body, highlight_terms(simplify_query(parse_query(query))), options);
+    };
+}
+
+// search(query, k) returns the k best hits; doc_lookup maps a hit to its
+// metadata, a DocRef with id 0 means "unknown doc". With a store, every hit
+// is followed by its snippet.
+template <typename SearchFn, typename DocFn>
+void run_query_loop(SearchFn search, DocFn doc_lookup, size_t top_k, const DocStore *store) {
+    SnippetLookup snippet;
+    if (store) snippet = snippets_from(*store, {30, "[", "]", false});
+    std::cout << "\nEnter boolean queries (use '&' for AND, '|' for OR, '!' for NOT, (...) for grouping,"
+                 " \"...\" for phrases, a NEAR/k b, prefix* and wildcards with ?)."
+                 " Empty line to exit." << std::endl;
+    std::string query;
+    while (true) {
+        std::cout << "> ";
+        if (!std::getline(std::cin, query)) break;
+        if (query.empty()) break;
+
+        auto hits = search(query, top_k);
+        if (hits.empty()) {
+            std::cout << "No documents found." << std::endl;
+            continue;
+        }
+
+        for (size_t i = 0; i < hits.size(); ++i) {
+            const auto &hit = hits[i];
+            DocRef doc = doc_lookup(hit.doc_id);
+            if (doc.id == 0) continue;
+            std::cout << (i + 1) << ". doc " << hit.doc_id << " score=" << hit.score;
+            if (!doc.title.empty()) std::cout << " | " << doc.title;
+            if (!doc.url.empty()) std::cout << " | " << doc.url;
+            std::cout << "\n";
+            if (snippet) std::cout << "   " << snippet(query, hit.doc_id) << "\n";
+        }
+        std::cout.flush();
+    }
+}
+
+// Answers queries from stdin, or from socket clients when --serve gave an address
+template <typename SearchFn, typename DocFn>
+bool answer_queries(SearchFn search, DocFn doc_lookup, size_t top_k, ServerOptions server,
+                    const DocStore *store = nullptr) {
+    if (server.address.empty()) {
+        run_query_loop(search, doc_lookup, top_k, store);
+        return true;
+    }
+    server.default_limit = top_k;
+    return serve_queries(server, search, doc_lookup, store ? snippets_from(*store, {}) : SnippetLookup());
+}
+}
 
 int main(int argc, char **argv) {
     std::string input_path = "data/all_docs.ndjson";
     std::string output_dir = "data";
+    std::string index_path;
+    std::string index_dir;
+    std::string shards_dir;
+    size_t shard_count = 0;
+    std::vector<uint64_t> delete_ids;
+    bool have_input = false;
     bool interactive = true;
+    size_t top_k = 10;
+    size_t threads = 1;
+    size_t memory_budget = 0;
+    RankingParams ranking;
+    bool positional = false;
+    bool snippets = false;
+    ServerOptions server;
+    size_t cache_bytes = 64 << 20;
+    BatchOptions batch;
+    std::string metrics_path;
+    double stats_interval = 0;
+    server.threads = std::max(1u, std::thread::hardware_concurrency());
 
     for (int i = 1; i < argc; ++i) {
         std::string arg = argv[i];
         if (arg.rfind("--input=", 0) == 0) {
             input_path = arg.substr(8);
+            have_input = true;
         } else if (arg.rfind("--output=", 0) == 0) {
             output_dir = arg.substr(9);
+        } else if (arg.rfind("--index=", 0) == 0) {
+            index_path = arg.substr(8);
+        } else if (arg.rfind("--index-dir=", 0) == 0) {
+            index_dir = arg.substr(12);
+        } else if (arg.rfind("--shards=", 0) == 0) {
+            shard_count = std::stoul(arg.substr(9));
+        } else if (arg.rfind("--shards-dir=", 0) == 0) {
+            shards_dir = arg.substr(13);
+        } else if (arg.rfind("--delete=", 0) == 0) {
+            std::stringstream ids(arg.substr(9));
+            std::string id;
+            while (std::getline(ids, id, ',')) {
+                if (!id.empty()) delete_ids.push_back(std::stoull(id));
+            }
+        } else if (arg.rfind("--top=", 0) == 0) {
+            top_k = std::stoul(arg.substr(6));
+        } else if (arg.rfind("--threads=", 0) == 0) {
+            threads = std::stoul(arg.substr(10));
+            if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+        } else if (arg.rfind("--memory-budget=", 0) == 0) {
+            memory_budget = parse_size(arg.substr(16));
+        } else if (arg.rfind("--ranking=", 0) == 0) {
+            if (!parse_ranking_mode(arg.substr(10), ranking.mode)) {
+                std::cerr << "Unknown ranking (use tf, tfidf or bm25): " << arg.substr(10) << "\n";
+                return 1;
+            }
+        } else if (arg.rfind("--bm25-k1=", 0) == 0) {
+            ranking.k1 = std::stof(arg.substr(10));
+        } else if (arg.rfind("--bm25-b=", 0) == 0) {
+            ranking.b = std::stof(arg.substr(9));
+        } else if (arg.rfind("--cache=", 0) == 0) {
+            cache_bytes = parse_size(arg.substr(8));
+        } else if (arg.rfind("--batch-queries=", 0) == 0) {
+            batch.queries_path = arg.substr(16);
+        } else if (arg.rfind("--batch-output=", 0) == 0) {
+            batch.output_path = arg.substr(15);
+        } else if (arg.rfind("--metrics=", 0) == 0) {
+            metrics_path = arg.substr(10);
+        } else if (arg.rfind("--stats-interval=", 0) == 0) {
+            stats_interval = std::stod(arg.substr(17));
+        } else if (arg == "--positional") {
+            positional = true;
+        } else if (arg == "--snippets") {
+            snippets = true;
+        } else if (arg.rfind("--serve=", 0) == 0) {
+            server.address = arg.substr(8);
+        } else if (arg.rfind("--serve-threads=", 0) == 0) {
+            server.threads = std::max<size_t>(1, std::stoul(arg.substr(16)));
         } else if (arg == "--no-search") {
             interactive = false;
         }
     }
 
+    batch.k = top_k;
+    batch.threads = threads;
+    if (batch.output_path.empty()) batch.output_path = output_dir + "/batch_results.tsv";
+
+    // Stage timers and counters only run when asked for; the reporter's
+    // destructor prints the totals and writes the final dump on every return
+    MetricsReporter reporter;
+    if (!metrics_path.empty() || stats_interval > 0) {
+        enable_metrics(true);
+        reporter.start(stats_interval, metrics_path);
+    }
+
+    if (!index_dir.empty()) {
+        // Incremental mode: append --input as a new segment, apply --delete, query all segments
+        SegmentedIndex segments;
+        if (!segments.open(index_dir)) return 1;
+        segments.set_ranking(ranking);
+        if (positional) segments.set_positional(true);
+        if (have_input) {
+            if (!std::filesystem::exists(input_path)) {
+                std::cerr << "Input file not found: " << input_path << "\n";
+                return 1;
+            }
+            std::cout << "[INFO] Appending documents from " << input_path << "..." << std::endl;
+            process_ndjson_views(input_path, [&](const DocumentView &doc) {
+                segments.add_document(doc);
+            }, 2000);
+        }
+        for (uint64_t id : delete_ids) {
+            if (!segments.delete_document(id)) std::cerr << "Unknown or deleted doc: " << id << "\n";
+        }
+        if (!segments.flush()) return 1;
+        segments.wait_for_merges();
+        segments.set_cache_capacity(cache_bytes / 2, cache_bytes / 2);
+        std::cout << "[INFO] " << segments.segment_count() << " segments, " << segments.doc_count()
+                  << " live docs in " << index_dir << std::endl;
+        print_stats(segments.stats(), segments.vocab_size());
+        if (!batch.queries_path.empty()) {
+            return run_batch_queries(batch, [&](const QueryNode &root, size_t k) { return segments.search(root, k); })
+                       ? 0 : 1;
+        }
+        if (!interactive && server.address.empty()) return 0;
+        if (snippets) std::cerr << "Snippets are not kept for --index-dir segments; ignoring --snippets\n";
+        bool served = answer_queries([&](const std::string &q, size_t k) { return segments.search(q, k); },
+                                     [&](uint64_t id) { return segments.doc(id); }, top_k, server);
+        if (cache_bytes) print_cache_stats(segments.result_cache_counters(), segments.pair_cache_counters());
+        return served ? 0 : 1;
+    }
+
+    if (!index_path.empty()) {
+        // Serve queries straight from a previously saved binary segment
+        MappedIndex mapped;
+        if (!mapped.open(index_path)) return 1;
+        mapped.set_ranking(ranking);
+        mapped.set_cache_capacity(cache_bytes / 2, cache_bytes / 2);
+        std::cout << "[INFO] Mapped index " << index_path << std::endl;
+        print_stats(mapped.stats(), mapped.vocab_size());
+        if (!batch.queries_path.empty()) return batch_over(mapped, batch) ? 0 : 1;
+        if (!interactive && server.address.empty()) return 0;
+        // The document store is written next to index.bin by a build with --snippets
+        DocStore store;
+        if (snippets && !store.open((std::filesystem::path(index_path).parent_path() / "docs.store").string())) {
+            return 1;
+        }
+        bool served = answer_queries([&](const std::string &q, size_t k) { return mapped.search(q, k); },
+                                     [&](uint64_t id) { return mapped.doc(id); }, top_k, server,
+                                     snippets ? &store : nullptr);
+        print_cache_stats(mapped.cache());
+        return served ? 0 : 1;
+    }
+
+    if (shard_count) {
+        // Sharded build: one segment per doc id range, then query them as below
+        if (!std::filesystem::exists(input_path)) {
+            std::cerr << "Input file not found: " << input_path << "\n";
+            return 1;
+        }
+        shards_dir = output_dir + "/shards";
+        std::cout << "[INFO] Splitting " << input_path << " into " << shard_count << " shards..." << std::endl;
+        if (!build_shards(input_path, shards_dir, shard_count, positional)) return 1;
+    }
+
+    if (!shards_dir.empty()) {
+        // Scatter each query over the shards, up to --threads of them at once
+        ShardedIndex sharded;
+        if (!sharded.open(shards_dir, threads)) return 1;
+        sharded.set_ranking(ranking);
+        sharded.set_cache_capacity(cache_bytes / 2, cache_bytes / 2);
+        std::cout << "[INFO] " << sharded.shard_count() << " shards, " << sharded.doc_count() << " docs in "
+                  << shards_dir << std::endl;
+        print_stats(sharded.stats(), sharded.vocab_size());
+        if (!batch.queries_path.empty()) {
+            return run_batch_queries(batch, [&](const QueryNode &root, size_t k) { return sharded.search(root, k); })
+                       ? 0 : 1;
+        }
+        if (!interactive && server.address.empty()) return 0;
+        if (snippets) std::cerr << "Snippets are not kept for shards; ignoring --snippets\n";
+        bool served = answer_queries([&](const std::string &q, size_t k) { return sharded.search(q, k); },
+                                     [&](uint64_t id) { return sharded.doc(id); }, top_k, server);
+        if (cache_bytes) print_cache_stats(sharded.result_cache_counters(), sharded.pair_cache_counters());
+        return served ? 0 : 1;
+    }
+
     if (!std::filesystem::exists(input_path)) {
         std::cerr << "Input file not found: " << input_path << "\n";
         std::cerr << "Run fetch_from_mongo.py first." << std::endl;
@@ -28,71 +321,109 @@ int main(int argc, char **argv) {
     }
 
     std::cout << "[INFO] Loading and indexing documents from " << input_path << "..." << std::endl;
+    std::filesystem::create_directories(output_dir);
+    std::string run_dir = output_dir + "/runs";
+    std::string store_path = output_dir + "/docs.store";
     InvertedIndex index;
-    process_ndjson_stream(input_path, [&](Document &&doc) {
-        index.add_document(doc);
-    }, 2000);
+    index.set_positional(positional);
+    index.set_ranking(ranking);
+    // With --snippets the docs go to the store while indexing and the index keeps only their ids
+    DocStoreWriter store_writer;
+    if (snippets) {
+        if (!store_writer.open(store_path)) return 1;
+        index.set_doc_store(&store_writer);
+    }
+    if (memory_budget) {
+        std::filesystem::create_directories(run_dir);
+        index.set_memory_budget(memory_budget, run_dir);
+    }
+    if (threads > 1) {
+        build_index_parallel(input_path, index, threads, 2000);
+    } else {
+        process_ndjson_views(input_path, [&](const DocumentView &doc) {
+            index.add_document(doc);
+        }, 2000);
+    }
 
     if (index.doc_count() == 0) {
         std::cerr << "No documents loaded. Check input." << std::endl;
         return 1;
     }
 
-    std::filesystem::create_directories(output_dir);
     std::string vocab_path = output_dir + "/vocabulary.tsv";
     std::string idx_path = output_dir + "/inverted_index.tsv";
     std::string docmap_path = output_dir + "/docs.tsv";
     std::string zipf_path = output_dir + "/zipf.tsv";
+    std::string bin_path = output_dir + "/index.bin";
 
-    index.save_vocabulary(vocab_path);
-    index.save_inverted_index(idx_path);
-    index.save_docmap(docmap_path);
-    auto zipf_rows = build_zipf_rows(index);
-    save_zipf_tsv(zipf_path, zipf_rows);
+    // The exports read doc metadata back from the store
+    DocStore store;
+    if (snippets && (!store_writer.finish() || !store.open(store_path))) return 1;
+    const DocStore *snippet_store = snippets ? &store : nullptr;
 
-    const auto &st = index.stats();
-    std::cout << "\n[STATS]\n";
-    std::cout << "  Documents: " << st.docs << "\n";
-    std::cout << "  Tokens:    " << st.tokens << "\n";
-    std::cout << "  Unique:    " << index.vocab_size() << "\n";
-    std::cout << "  Avg len:   " << (st.tokens ? (double)st.token_chars / st.tokens : 0.0) << "\n";
-    std::cout << "  Bytes in:  " << st.bytes_in << "\n";
+    size_t vocab_size = index.vocab_size();
+    if (memory_budget) {
+        // Spill what is left, then stream-merge all runs into the final outputs
+        index.flush_run();
+        std::cout << "[INFO] Merging " << index.runs().size() << " runs..." << std::endl;
+        std::vector<TermStats> vocab;
+        merge_runs(index.runs(), index.doc_count(), index.metadata(snippet_store), index.doc_length_array(),
+                   index.stats(), bin_path, idx_path, vocab);
+        std::filesystem::remove_all(run_dir);
+        vocab_size = vocab.size();
+        if (!export_merged(index, vocab, {vocab_path, "", docmap_path, zipf_path, ""}, threads, snippet_store)) {
+            return 1;
+        }
+    } else if (!export_index(index, {vocab_path, idx_path, docmap_path, zipf_path, bin_path}, threads,
+                             snippet_store)) {
+        return 1;
+    }
+
+    print_stats(index.stats(), vocab_size);
 
     std::cout << "\n[OUTPUT]\n";
     std::cout << "  " << vocab_path << "\n";
     std::cout << "  " << idx_path << "\n";
     std::cout << "  " << docmap_path << "\n";
     std::cout << "  " << zipf_path << "\n";
+    std::cout << "  " << bin_path << "\n";
+    if (snippets) std::cout << "  " << store_path << "\n";
 
-    if (!interactive) return 0;
-
-    std::cout << "\nEnter boolean queries (use '&' for AND, '|' for OR). Empty line to exit." << std::endl;
-    std::string query;
-    while (true) {
-        std::cout << "> ";
-        if (!std::getline(std::cin, query)) break;
-        if (query.empty()) break;
-
-        auto hits = index.search(query);
-        if (hits.empty()) {
-            std::cout << "No documents found." << std::endl;
-            continue;
-        }
+    if (!batch.queries_path.empty()) {
+        if (!memory_budget) return batch_over(index, batch) ? 0 : 1;
+        MappedIndex mapped;
+        if (!mapped.open(bin_path)) return 1;
+        mapped.set_ranking(ranking);
+        return batch_over(mapped, batch) ? 0 : 1;
+    }
+    if (!interactive && server.address.empty()) return 0;
 
-        size_t limit = std::min<size_t>(hits.size(), 10);
-        for (size_t i = 0; i < limit; ++i) {
-            const auto &hit = hits[i];
-            if (hit.doc_id == 0 || hit.doc_id > index.docs().size()) continue;
-            const Document &doc = index.docs()[hit.doc_id - 1];
-            std::cout << (i + 1) << ". doc " << hit.doc_id << " score=" << hit.score;
-            if (!doc.title.empty()) std::cout << " | " << doc.title;
-            if (!doc.url.empty()) std::cout << " | " << doc.url;
-            std::cout << "\n";
-        }
-        if (hits.size() > limit) {
-            std::cout << "... and " << (hits.size() - limit) << " more" << std::endl;
-        }
+    if (memory_budget) {
+        // Postings only exist on disk now; query the merged segment
+        MappedIndex mapped;
+        if (!mapped.open(bin_path)) return 1;
+        mapped.set_ranking(ranking);
+        mapped.set_cache_capacity(cache_bytes / 2, cache_bytes / 2);
+        bool served = answer_queries([&](const std::string &q, size_t k) { return mapped.search(q, k); },
+                                     [&](uint64_t id) { return mapped.doc(id); }, top_k, server, snippet_store);
+        print_cache_stats(mapped.cache());
+        return served ? 0 : 1;
     }
 
-    return 0;
+    index.set_cache_capacity(cache_bytes / 2, cache_bytes / 2);
+    bool served = answer_queries([&](const std::string &q, size_t k) { return index.search(q, k); },
+                                 [&](uint64_t id) -> DocRef {
+                                     if (id == 0 || id > index.docs().size()) return {};
+                                     if (snippet_store) {
+                                         // The views stay valid until this thread's next lookup
+                                         thread_local StoredDoc stored;
+                                         if (!snippet_store->get(id, stored)) return {};
+                                         return {stored.id, stored.source, stored.url, stored.title};
+                                     }
+                                     const Document &doc = index.docs()[id - 1];
+                                     return {doc.id, doc.source, doc.url, doc.title};
+                                 }, top_k, server, snippet_store);
+    print_cache_stats(index.cache());
+
+    return served ? 0 : 1;
 }
@@ -0,0 +1,172 @@
+#include "mapped_index.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+static_assert(sizeof(PostingSkip) == 16, "on-disk skip layout");
+
+MappedIndex::~MappedIndex() {
+    close();
+}
+
+void MappedIndex::close() {
+    file_.close();
+    header_ = nullptr;
+    if (cache_) cache_->clear();
+}
+
+bool MappedIndex::open(const std::string &path) {
+    close();
+    if (!file_.open(path)) {
+        std::cerr << "Cannot map index file: " << path << "\n";
+        return false;
+    }
+    const char *base = file_.data();
+    size_t size = file_.size();
+    header_ = reinterpret_cast<const segment::SegmentHeader *>(base);
+    if (size < sizeof(segment::SegmentHeader) ||
+        std::memcmp(header_->magic, segment::kMagic, sizeof(segment::kMagic)) != 0 ||
+        header_->version != segment::kVersion || header_->file_size != size ||
+        header_->doc_strings_off > size) {
+        std::cerr << "Unsupported or corrupt index file: " << path << "\n";
+        close();
+        return false;
+    }
+
+    terms_ = reinterpret_cast<const segment::TermEntry *>(base + header_->terms_off);
+    term_strings_ = base + header_->term_strings_off;
+    skips_ = reinterpret_cast<const PostingSkip *>(base + header_->skips_off);
+    postings_ = reinterpret_cast<const uint8_t *>(base + header_->postings_off);
+    if (header_->flags & segment::kFlagPositional) {
+        position_blocks_ = reinterpret_cast<const uint64_t *>(base + header_->position_blocks_off);
+        positions_ = reinterpret_cast<const uint8_t *>(base + header_->positions_off);
+    } else {
+        position_blocks_ = nullptr;
+        positions_ = nullptr;
+    }
+    docs_ = reinterpret_cast<const segment::DocEntry *>(base + header_->docs_off);
+    doc_lengths_ = reinterpret_cast<const uint32_t *>(base + header_->doc_lengths_off);
+    doc_strings_ = base + header_->doc_strings_off;
+    return true;
+}
+
+std::string_view MappedIndex::term_at(size_t i) const {
+    return {term_strings_ + terms_[i].str_off, terms_[i].str_len};
+}
+
+size_t MappedIndex::lower_bound(std::string_view term) const {
+    size_t lo = 0, hi = vocab_size();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (term_at(mid) < term) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+PostingListView MappedIndex::postings(std::string_view term) const {
+    if (!header_) return {};
+    size_t i = lower_bound(term);
+    if (i == header_->term_count || term_at(i) != term) return {};
+    return postings_at(i);
+}
+
+// The term table is already byte ordered, so the prefix range is found by
+// binary search and no separate sorted dictionary is needed
+std::shared_ptr<const PostingList> MappedIndex::pattern_postings(const std::string &pattern) const {
+    PatternCache *cache = cache_ && cache_->patterns.enabled() ? &cache_->patterns : nullptr;
+    if (cache) {
+        if (auto hit = cache->find(pattern)) return hit;
+    }
+    std::string_view prefix = pattern_prefix(pattern);
+    std::vector<PostingListView> matches;
+    for (size_t i = lower_bound(prefix); i < vocab_size(); ++i) {
+        std::string_view term = term_at(i);
+        if (term.substr(0, prefix.size()) != prefix) break;
+        if (match_term_pattern(pattern, term)) matches.push_back(postings_at(i));
+    }
+    auto list = std::make_shared<const PostingList>(merge_pattern_postings(std::move(matches)));
+    if (cache) cache->insert(pattern, list, list->byte_size());
+    return list;
+}
+
+PostingListView MappedIndex::postings_at(size_t i) const {
+    const auto &entry = terms_[i];
+    PostingListView view{postings_ + entry.postings_off, skips_ + entry.skips_off,
+                         static_cast<size_t>(entry.postings_count)};
+    if (position_blocks_) {
+        view.positions = positions_ + entry.positions_off;
+        view.position_blocks = position_blocks_ + entry.position_blocks_off;
+    }
+    return view;
+}
+
+std::vector<SearchHit> MappedIndex::search(const std::string &query, size_t k, const DocBitmap *deleted,
+                                           const Scorer *scorer) const {
+    if (cache_ && !deleted && !scorer) {
+        return cached_search(query, k, cache_->results, [&](const QueryNode &root) { return search(root, k); });
+    }
+    return search(simplify_query(parse_query(query)), k, deleted, scorer);
+}
+
+std::vector<SearchHit> MappedIndex::search(const QueryNode &root, size_t k, const DocBitmap *deleted,
+                                           const Scorer *scorer) const {
+    Scorer own;
+    if (!scorer) {
+        own = Scorer(ranking_, collection_stats(), doc_lengths());
+        scorer = &own;
+    }
+    return run_query_tree(root, [this](const std::string &term) { return postings(term); }, k, deleted, scorer,
+                          cache_ ? &cache_->pairs : nullptr,
+                          [this](const std::string &pattern) { return pattern_postings(pattern); },
+                          cache_ ? &cache_->doc_sets : nullptr);
+}
+
+void MappedIndex::set_ranking(const RankingParams &params) {
+    ranking_ = params;
+    if (cache_) cache_->clear();
+}
+
+void MappedIndex::set_cache_capacity(size_t result_bytes, size_t pair_bytes) {
+    if (result_bytes || pair_bytes) cache_ = std::make_unique<QueryCache>(result_bytes, pair_bytes);
+    else cache_.reset();
+}
+
+CollectionStats MappedIndex::collection_stats() const {
+    if (!header_) return {};
+    return {header_->doc_count, header_->total_doc_length};
+}
+
+TokenizationStats MappedIndex::stats() const {
+    TokenizationStats st;
+    if (!header_) return st;
+    st.docs = header_->stat_docs;
+    st.tokens = header_->stat_tokens;
+    st.token_chars = header_->stat_token_chars;
+    st.bytes_in = header_->stat_bytes_in;
+    return st;
+}
+
+// Ids are ascending; segments without deleted docs are dense, so try the direct slot first
+DocRef MappedIndex::doc(uint64_t doc_id) const {
+    if (!header_ || header_->doc_count == 0 || doc_id < first_doc_id()) return {};
+    size_t n = header_->doc_count;
+    uint64_t slot = doc_id - first_doc_id();
+    if (slot < n && docs_[slot].id == doc_id) return doc_at(slot);
+    const segment::DocEntry *it = std::lower_bound(docs_, docs_ + n, doc_id,
+        [](const segment::DocEntry &e, uint64_t id) { return e.id < id; });
+    if (it == docs_ + n || it->id != doc_id) return {};
+    return doc_at(static_cast<size_t>(it - docs_));
+}
+
+DocRef MappedIndex::doc_at(size_t i) const {
+    const auto &entry = docs_[i];
+    const char *p = doc_strings_ + entry.str_off;
+    DocRef ref;
+    ref.id = entry.id;
+    ref.source = {p, entry.source_len};
+    ref.url = {p + entry.source_len, entry.url_len};
+    ref.title = {p + entry.source_len + entry.url_len, entry.title_len};
+    return ref;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "index_format.hpp"
+#include "mapped_file.hpp"
+#include "query.hpp"
+#include "tokenizer.hpp"
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct DocRef {
+    uint64_t id{0};
+    std::string_view source;
+    std::string_view url;
+    std::string_view title;
+};
+
+// Read-only view over a segment written by InvertedIndex::save_binary.
+// The file is mmapped, so several query processes share one copy in the page cache.
+class MappedIndex {
+public:
+    MappedIndex() = default;
+    ~MappedIndex();
+    MappedIndex(const MappedIndex &) = delete;
+    MappedIndex &operator=(const MappedIndex &) = delete;
+
+    bool open(const std::string &path);
+    void close();
+    bool is_open() const { return file_.is_open(); }
+
+    // Scores with the index's own ranking unless a scorer is given. Plain searches
+    // (no deleted, no scorer) go through the result cache once enabled
+    std::vector<SearchHit> search(const std::string &query, size_t k = 0, const DocBitmap *deleted = nullptr,
+                                  const Scorer *scorer = nullptr) const;
+    std::vector<SearchHit> search(const QueryNode &root, size_t k = 0, const DocBitmap *deleted = nullptr,
+                                  const Scorer *scorer = nullptr) const;
+    void set_ranking(const RankingParams &params);
+    // Zero for both disables caching; close() and set_ranking() clear the cache
+    void set_cache_capacity(size_t result_bytes, size_t pair_bytes);
+    const QueryCache *cache() const { return cache_.get(); }
+    const RankingParams &ranking() const { return ranking_; }
+    PostingListView postings(std::string_view term) const;
+    // Union of the postings of the terms matching a pattern (see PatternLookup)
+    std::shared_ptr<const PostingList> pattern_postings(const std::string &pattern) const;
+
+    // Term table in byte order, for merging segments
+    std::string_view term_at(size_t i) const;
+    const segment::TermEntry &term_entry(size_t i) const { return terms_[i]; }
+    PostingListView postings_at(size_t i) const;
+
+    bool positional() const { return position_blocks_ != nullptr; }
+    size_t vocab_size() const { return header_ ? header_->term_count : 0; }
+    size_t doc_count() const { return header_ ? header_->doc_count : 0; }
+    TokenizationStats stats() const;
+    CollectionStats collection_stats() const;
+    // One slot per id in the segment's range, so merged segments with gaps still line up
+    DocLengthsView doc_lengths() const {
+        return {doc_lengths_, first_doc_id(), doc_count() ? last_doc_id() - first_doc_id() + 1 : 0};
+    }
+
+    // Returns id 0 when the segment does not hold doc_id
+    DocRef doc(uint64_t doc_id) const;
+    DocRef doc_at(size_t i) const;
+    uint64_t first_doc_id() const { return doc_count() ? docs_[0].id : 0; }
+    uint64_t last_doc_id() const { return doc_count() ? docs_[doc_count() - 1].id : 0; }
+
+private:
+    MappedFile file_;
+    const segment::SegmentHeader *header_{nullptr};
+    const segment::TermEntry *terms_{nullptr};
+    const char *term_strings_{nullptr};
+    const PostingSkip *skips_{nullptr};
+    const uint8_t *postings_{nullptr};
+    const uint64_t *position_blocks_{nullptr};  // nullptr for a non-positional segment
+    const uint8_t *positions_{nullptr};
+    const segment::DocEntry *docs_{nullptr};
+    const uint32_t *doc_lengths_{nullptr};
+    const char *doc_strings_{nullptr};
+    RankingParams ranking_;
+    std::unique_ptr<QueryCache> cache_;
+
+    // Index of the first term >= term
+    size_t lower_bound(std::string_view term) const;
+};
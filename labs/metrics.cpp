@@ -0,0 +1,254 @@
+#include "metrics.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <vector>
+
+std::atomic<bool> g_metrics_enabled{false};
+
+namespace {
+// Written only by the owning thread (load + store, no locked add); read by snapshots
+struct ThreadMetrics {
+    std::atomic<uint64_t> stage_ns[kStageCount];
+    std::atomic<uint64_t> stage_calls[kStageCount];
+    std::atomic<uint64_t> counters[kCounterCount];
+};
+
+inline void bump(std::atomic<uint64_t> &value, uint64_t n) {
+    value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+// Blocks of exited threads are folded into retired and reused by new threads.
+// Never destroyed: threads may still exit after static destructors ran.
+struct Registry {
+    std::mutex mu;
+    std::vector<ThreadMetrics *> live;
+    std::vector<ThreadMetrics *> spare;
+    MetricsSnapshot retired;
+};
+
+Registry &registry() {
+    static Registry *r = new Registry;
+    return *r;
+}
+
+// Constant-initialized, so operator new can read it without a TLS init guard
+thread_local ThreadMetrics *tls_metrics = nullptr;
+
+void add_into(MetricsSnapshot &out, const ThreadMetrics &m) {
+    for (size_t i = 0; i < kStageCount; ++i) {
+        out.stage_ns[i] += m.stage_ns[i].load(std::memory_order_relaxed);
+        out.stage_calls[i] += m.stage_calls[i].load(std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < kCounterCount; ++i) out.counters[i] += m.counters[i].load(std::memory_order_relaxed);
+}
+
+struct ThreadDetach {
+    ~ThreadDetach() {
+        ThreadMetrics *m = tls_metrics;
+        if (!m) return;
+        tls_metrics = nullptr;
+        Registry &r = registry();
+        std::lock_guard<std::mutex> lock(r.mu);
+        add_into(r.retired, *m);
+        for (auto &v : m->stage_ns) v.store(0, std::memory_order_relaxed);
+        for (auto &v : m->stage_calls) v.store(0, std::memory_order_relaxed);
+        for (auto &v : m->counters) v.store(0, std::memory_order_relaxed);
+        for (size_t i = 0; i < r.live.size(); ++i) {
+            if (r.live[i] == m) {
+                r.live[i] = r.live.back();
+                r.live.pop_back();
+                break;
+            }
+        }
+        r.spare.push_back(m);
+    }
+};
+
+ThreadMetrics &local_metrics() {
+    if (tls_metrics) return *tls_metrics;
+    static thread_local ThreadDetach detach;
+    (void)detach;
+    Registry &r = registry();
+    ThreadMetrics *m = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(r.mu);
+        if (!r.spare.empty()) {
+            m = r.spare.back();
+            r.spare.pop_back();
+        } else {
+            m = new ThreadMetrics();  // tls_metrics is still null: not counted as an allocation
+        }
+        r.live.push_back(m);
+    }
+    tls_metrics = m;
+    return *m;
+}
+
+const char *const kStageNames[kStageCount] = {"parse",         "strip_tags", "tokenize",    "stem",
+                                              "insert",        "flush",      "query_parse", "posting_fetch",
+                                              "match",         "sort"};
+const char *const kCounterNames[kCounterCount] = {"documents",  "input_bytes", "tokens", "postings",
+                                                  "queries",    "candidates",  "scored", "pruned",
+                                                  "allocations", "allocated_bytes"};
+
+uint64_t delta(const uint64_t *now, const uint64_t *before, size_t i) {
+    return now[i] >= before[i] ? now[i] - before[i] : 0;
+}
+}
+
+// Counts allocations of instrumented threads while metrics are on
+void *operator new(std::size_t size) {
+    if (tls_metrics && metrics_enabled()) {
+        bump(tls_metrics->counters[static_cast<size_t>(Counter::Allocations)], 1);
+        bump(tls_metrics->counters[static_cast<size_t>(Counter::AllocatedBytes)], size);
+    }
+    if (void *p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void enable_metrics(bool on) {
+    g_metrics_enabled.store(on, std::memory_order_relaxed);
+}
+
+void record_counter(Counter counter, uint64_t n) {
+    bump(local_metrics().counters[static_cast<size_t>(counter)], n);
+}
+
+void record_stage(Stage stage, uint64_t ns) {
+    ThreadMetrics &m = local_metrics();
+    bump(m.stage_ns[static_cast<size_t>(stage)], ns);
+    bump(m.stage_calls[static_cast<size_t>(stage)], 1);
+}
+
+MetricsSnapshot metrics_snapshot() {
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mu);
+    MetricsSnapshot s = r.retired;
+    for (const ThreadMetrics *m : r.live) add_into(s, *m);
+    return s;
+}
+
+const char *stage_name(Stage stage) {
+    return kStageNames[static_cast<size_t>(stage)];
+}
+
+const char *counter_name(Counter counter) {
+    return kCounterNames[static_cast<size_t>(counter)];
+}
+
+std::string format_stats_line(const MetricsSnapshot &now, const MetricsSnapshot &before, double seconds) {
+    std::ostringstream line;
+    line.setf(std::ios::fixed);
+    line.precision(1);
+    line << "[METRICS] " << seconds << "s";
+    auto rate = [seconds](uint64_t n) { return seconds > 0 ? n / seconds : 0.0; };
+    uint64_t docs = delta(now.counters, before.counters, static_cast<size_t>(Counter::Documents));
+    uint64_t queries = delta(now.counters, before.counters, static_cast<size_t>(Counter::Queries));
+    if (docs) line << " docs +" << docs << " (" << rate(docs) << "/s)";
+    if (queries) line << " queries +" << queries << " (" << rate(queries) << "/s)";
+    line << " |";
+    line.precision(3);
+    for (size_t i = 0; i < kStageCount; ++i) {
+        if (!delta(now.stage_calls, before.stage_calls, i)) continue;
+        line << ' ' << kStageNames[i] << ' ' << delta(now.stage_ns, before.stage_ns, i) / 1e9 << 's';
+    }
+    uint64_t allocs = delta(now.counters, before.counters, static_cast<size_t>(Counter::Allocations));
+    if (allocs) {
+        line << " | allocs +" << allocs << " ("
+             << delta(now.counters, before.counters, static_cast<size_t>(Counter::AllocatedBytes)) / 1048576.0
+             << " MB)";
+    }
+    return line.str();
+}
+
+void write_prometheus(std::ostream &out, const MetricsSnapshot &snapshot) {
+    out << "# HELP labs_stage_seconds_total Time spent in each indexing or query stage, summed over threads.\n"
+        << "# TYPE labs_stage_seconds_total counter\n";
+    for (size_t i = 0; i < kStageCount; ++i) {
+        out << "labs_stage_seconds_total{stage=\"" << kStageNames[i] << "\"} " << snapshot.stage_ns[i] / 1e9 << "\n";
+    }
+    out << "# HELP labs_stage_calls_total Timed sections entered per stage.\n"
+        << "# TYPE labs_stage_calls_total counter\n";
+    for (size_t i = 0; i < kStageCount; ++i) {
+        out << "labs_stage_calls_total{stage=\"" << kStageNames[i] << "\"} " << snapshot.stage_calls[i] << "\n";
+    }
+    for (size_t i = 0; i < kCounterCount; ++i) {
+        out << "# TYPE labs_" << kCounterNames[i] << "_total counter\n"
+            << "labs_" << kCounterNames[i] << "_total " << snapshot.counters[i] << "\n";
+    }
+}
+
+bool save_prometheus(const std::string &path, const MetricsSnapshot &snapshot) {
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        if (!out) {
+            std::cerr << "Cannot write metrics: " << tmp << "\n";
+            return false;
+        }
+        write_prometheus(out, snapshot);
+        if (!out) return false;
+    }
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::cerr << "Cannot write metrics: " << path << "\n";
+        return false;
+    }
+    return true;
+}
+
+MetricsReporter::~MetricsReporter() {
+    stop();
+}
+
+void MetricsReporter::start(double interval_s, const std::string &prometheus_path) {
+    stop();
+    interval_s_ = interval_s;
+    path_ = prometheus_path;
+    last_ = metrics_snapshot();
+    last_time_ = std::chrono::steady_clock::now();
+    running_ = true;
+    if (interval_s_ <= 0) return;
+    thread_ = std::thread([this] {
+        auto period = std::chrono::duration<double>(interval_s_);
+        std::unique_lock<std::mutex> lock(mu_);
+        while (running_) {
+            if (cv_.wait_for(lock, period, [this] { return !running_; })) break;
+            report(false);
+        }
+    });
+}
+
+void MetricsReporter::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        if (!running_) return;
+        running_ = false;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) thread_.join();
+    report(true);
+}
+
+void MetricsReporter::report(bool final_report) {
+    MetricsSnapshot now = metrics_snapshot();
+    auto t = std::chrono::steady_clock::now();
+    if (interval_s_ > 0 || final_report) {
+        std::cerr << format_stats_line(now, last_, std::chrono::duration<double>(t - last_time_).count()) << std::endl;
+    }
+    if (!path_.empty()) save_prometheus(path_, now);
+    last_ = now;
+    last_time_ = t;
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+
+// Timed stages of indexing and search. Stages may nest (tokenize contains the
+// tag skipping, match contains scoring), so their times do not add up.
+enum class Stage : uint8_t {
+    Parse,         // NDJSON line scan and unescaping
+    StripTags,     // strip_tags(); tokenize_document skips tags inline
+    Tokenize,
+    Stem,          // stemming and interning a document's terms
+    Insert,        // posting appends
+    Flush,         // SPIMI runs, segment and binary index writes
+    QueryParse,
+    PostingFetch,  // term lookups and weights
+    Match,         // plan build and doc-at-a-time intersection with scoring
+    Sort,          // top-k extraction and merging per-segment hits
+    Count
+};
+
+enum class Counter : uint8_t {
+    Documents,
+    InputBytes,
+    Tokens,
+    Postings,
+    Queries,
+    Candidates,  // docs produced by query plans
+    Scored,      // candidates scored exactly
+    Pruned,      // candidates skipped by block-max bounds
+    Allocations,
+    AllocatedBytes,
+    Count
+};
+
+constexpr size_t kStageCount = static_cast<size_t>(Stage::Count);
+constexpr size_t kCounterCount = static_cast<size_t>(Counter::Count);
+
+struct MetricsSnapshot {
+    uint64_t stage_ns[kStageCount]{};
+    uint64_t stage_calls[kStageCount]{};
+    uint64_t counters[kCounterCount]{};
+};
+
+// Off by default: a disabled timer or counter costs one relaxed load. Values are
+// kept per thread and only summed by metrics_snapshot(). Allocations (global
+// operator new) are counted on threads that have recorded anything else.
+extern std::atomic<bool> g_metrics_enabled;
+inline bool metrics_enabled() { return g_metrics_enabled.load(std::memory_order_relaxed); }
+void enable_metrics(bool on);
+
+void record_counter(Counter counter, uint64_t n);
+void record_stage(Stage stage, uint64_t ns);
+inline void add_counter(Counter counter, uint64_t n = 1) {
+    if (metrics_enabled()) record_counter(counter, n);
+}
+
+MetricsSnapshot metrics_snapshot();
+const char *stage_name(Stage stage);
+const char *counter_name(Counter counter);
+
+// One line of deltas since `before`, e.g. "[METRICS] 10.0s docs +5200 (520/s) | tokenize 4.1s ..."
+std::string format_stats_line(const MetricsSnapshot &now, const MetricsSnapshot &before, double seconds);
+// Prometheus text exposition format, all series prefixed with labs_
+void write_prometheus(std::ostream &out, const MetricsSnapshot &snapshot);
+// Written to a temporary file and renamed, so scrapers never see a partial dump
+bool save_prometheus(const std::string &path, const MetricsSnapshot &snapshot);
+
+class StageTimer {
+public:
+    explicit StageTimer(Stage stage) : stage_(stage), on_(metrics_enabled()) {
+        if (on_) start_ = std::chrono::steady_clock::now();
+    }
+    ~StageTimer() {
+        if (on_) {
+            auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_);
+            record_stage(stage_, static_cast<uint64_t>(ns.count()));
+        }
+    }
+    StageTimer(const StageTimer &) = delete;
+    StageTimer &operator=(const StageTimer &) = delete;
+
+private:
+    Stage stage_;
+    bool on_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// Background thread printing a stats line to stderr every interval and
+// rewriting the Prometheus dump (if a path is set). Stopping writes both once more.
+class MetricsReporter {
+public:
+    MetricsReporter() = default;
+    ~MetricsReporter();
+    MetricsReporter(const MetricsReporter &) = delete;
+    MetricsReporter &operator=(const MetricsReporter &) = delete;
+
+    // interval_s == 0 prints no periodic lines; the dump is then only written by stop()
+    void start(double interval_s, const std::string &prometheus_path);
+    void stop();
+
+private:
+    double interval_s_{0};
+    std::string path_;
+    MetricsSnapshot last_;
+    std::chrono::steady_clock::time_point last_time_;
+    std::mutex mu_;
+    std::condition_variable cv_;
+    bool running_{false};
+    std::thread thread_;
+
+    void report(bool final_report);
+};
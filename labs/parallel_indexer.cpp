@@ -0,0 +1,124 @@
+#include "parallel_indexer.hpp"
+#include "loader.hpp"
+#include "mapped_file.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace {
+constexpr size_t kChunkLines = 256;
+
+struct Chunk {
+    size_t seq;
+    std::string_view data;  // whole lines of the mapped input
+};
+}
+
+void build_index_parallel(const std::string &path, InvertedIndex &index, size_t threads,
+                          size_t progress_every) {
+    MappedFile file;
+    if (!file.open(path)) {
+        std::cerr << "Cannot open input NDJSON: " << path << "\n";
+        return;
+    }
+    file.advise_sequential();
+    std::string_view input = file.view();
+    if (threads == 0) threads = 1;
+    // Bounds chunks that are read but not merged yet, so memory stays flat
+    const size_t max_inflight = threads * 4;
+
+    std::mutex mu;
+    std::condition_variable work_cv;
+    std::condition_variable done_cv;
+    std::condition_variable space_cv;
+    std::deque<Chunk> work;
+    std::map<size_t, PartialIndex> done;
+    size_t produced = 0;
+    size_t merged = 0;
+    bool eof = false;
+
+    std::thread reader([&]() {
+        size_t offset = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mu);
+                space_cv.wait(lock, [&]() { return produced - merged < max_inflight; });
+            }
+            // Cut the next kChunkLines lines; the data itself is never copied
+            size_t end = offset;
+            for (size_t n = 0; n < kChunkLines && end < input.size(); ++n) {
+                const char *nl = static_cast<const char *>(std::memchr(input.data() + end, '\n', input.size() - end));
+                end = nl ? static_cast<size_t>(nl - input.data()) + 1 : input.size();
+            }
+            Chunk chunk;
+            chunk.data = input.substr(offset, end - offset);
+            offset = end;
+            std::lock_guard<std::mutex> lock(mu);
+            if (chunk.data.empty()) {
+                eof = true;
+                work_cv.notify_all();
+                done_cv.notify_all();
+                return;
+            }
+            chunk.seq = produced++;
+            work.push_back(std::move(chunk));
+            work_cv.notify_one();
+        }
+    });
+
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&]() {
+            NdjsonScanner scanner;
+            while (true) {
+                Chunk chunk;
+                {
+                    std::unique_lock<std::mutex> lock(mu);
+                    work_cv.wait(lock, [&]() { return !work.empty() || eof; });
+                    if (work.empty()) return;
+                    chunk = std::move(work.front());
+                    work.pop_front();
+                }
+                PartialIndex part;
+                part.positional = index.positional();
+                part.store_docs = index.stores_docs();
+                for_each_line(chunk.data, [&](std::string_view line) {
+                    DocumentView doc;
+                    if (scanner.parse(line, doc)) part.add_document(doc);
+                });
+                std::lock_guard<std::mutex> lock(mu);
+                done.emplace(chunk.seq, std::move(part));
+                done_cv.notify_all();
+            }
+        });
+    }
+
+    size_t reported = 0;
+    std::unique_lock<std::mutex> lock(mu);
+    while (true) {
+        done_cv.wait(lock, [&]() { return done.count(merged) || (eof && merged == produced); });
+        auto it = done.find(merged);
+        if (it == done.end()) break;
+        PartialIndex part = std::move(it->second);
+        done.erase(it);
+        ++merged;
+        space_cv.notify_one();
+        lock.unlock();
+
+        index.merge(std::move(part));
+        if (progress_every && index.doc_count() / progress_every > reported) {
+            reported = index.doc_count() / progress_every;
+            std::cout << "  [LOAD] processed " << index.doc_count() << " documents" << std::endl;
+        }
+        lock.lock();
+    }
+    lock.unlock();
+
+    reader.join();
+    for (auto &w : workers) w.join();
+}
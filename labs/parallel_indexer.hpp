@@ -0,0 +1,12 @@
+#pragma once
+
+#include "index.hpp"
+
+#include <string>
+
+// Pipelined NDJSON indexing: one reader thread cuts the mmapped input into line chunks,
+// `threads` workers parse and tokenize each chunk into a PartialIndex, and the
+// calling thread merges the partial indexes in input order, so doc ids match
+// process_ndjson_stream exactly.
+void build_index_parallel(const std::string &path, InvertedIndex &index, size_t threads,
+                          size_t progress_every = 5000);
@@ -0,0 +1,77 @@
+#include "postings.hpp"
+
+#include <algorithm>
+#include <functional>
+
+void write_varint(std::vector<uint8_t> &out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<uint8_t>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(v));
+}
+
+void write_varint(std::string &out, uint64_t v) {
+    while (v >= 0x80) {
+        out += static_cast<char>(v | 0x80);
+        v >>= 7;
+    }
+    out += static_cast<char>(v);
+}
+
+void PostingList::push_back(uint64_t doc_id, uint32_t tf, const uint32_t *positions) {
+    if (count_ % kPostingBlockSize == 0) {
+        skips_.push_back({doc_id, static_cast<uint32_t>(bytes_.size()), tf});
+        if (positions) position_blocks_.push_back(positions_.size());
+    }
+    if (positions) {
+        uint32_t prev = 0;
+        for (uint32_t i = 0; i < tf; ++i) {
+            write_varint(positions_, positions[i] - prev);
+            prev = positions[i];
+        }
+    }
+    PostingSkip &skip = skips_.back();
+    skip.last_doc = doc_id;
+    skip.max_tf = std::max(skip.max_tf, tf);
+    write_varint(bytes_, doc_id - last_doc_);
+    write_varint(bytes_, tf);
+    last_doc_ = doc_id;
+    ++count_;
+}
+
+uint32_t max_tf(const PostingListView &list) {
+    uint32_t best = 0;
+    for (size_t b = 0; b < list.block_count(); ++b) best = std::max(best, list.skips[b].max_tf);
+    return best;
+}
+
+PostingList merge_postings(const std::vector<PostingListView> &lists) {
+    std::vector<PostingIterator> its;
+    std::vector<std::pair<uint64_t, size_t>> heap;
+    for (const auto &list : lists) {
+        if (list.empty()) continue;
+        its.emplace_back(list);
+        heap.emplace_back(its.back().doc(), its.size() - 1);
+    }
+    std::make_heap(heap.begin(), heap.end(), std::greater<>());
+    PostingList out;
+    while (!heap.empty()) {
+        uint64_t doc = heap.front().first;
+        uint32_t tf = 0;
+        while (!heap.empty() && heap.front().first == doc) {
+            std::pop_heap(heap.begin(), heap.end(), std::greater<>());
+            PostingIterator &it = its[heap.back().second];
+            tf += it.tf();
+            it.next();
+            if (it.valid()) {
+                heap.back().first = it.doc();
+                std::push_heap(heap.begin(), heap.end(), std::greater<>());
+            } else {
+                heap.pop_back();
+            }
+        }
+        out.push_back(doc, tf);
+    }
+    return out;
+}
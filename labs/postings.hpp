@@ -0,0 +1,179 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct Posting {
+    uint64_t doc_id;
+    uint32_t tf;
+};
+
+// Postings are stored as blocks of kPostingBlockSize entries; every entry is a
+// varint doc-id gap (relative to the previous posting) followed by a varint tf.
+// One skip entry per block lets readers jump over whole blocks.
+// Positional lists keep token positions in a side stream: per posting, tf
+// varints of position deltas (the first is absolute), with the stream offset of
+// every block start so skipping a block skips its positions too.
+constexpr size_t kPostingBlockSize = 128;
+
+struct PostingSkip {
+    uint64_t last_doc;   // largest doc id in the block
+    uint32_t offset;     // byte offset of the block start
+    uint32_t max_tf;     // largest tf in the block
+};
+
+// Non-owning view over an encoded posting list (in memory or mmapped)
+struct PostingListView {
+    const uint8_t *bytes{nullptr};
+    const PostingSkip *skips{nullptr};
+    size_t count{0};
+    const uint8_t *positions{nullptr};         // nullptr for a non-positional list
+    const uint64_t *position_blocks{nullptr};  // positions offset per block
+
+    size_t block_count() const { return (count + kPostingBlockSize - 1) / kPostingBlockSize; }
+    bool empty() const { return count == 0; }
+};
+
+// Append-only encoder; doc ids must be pushed in increasing order
+class PostingList {
+public:
+    // positions holds tf ascending token positions, or nullptr for a non-positional list
+    void push_back(uint64_t doc_id, uint32_t tf, const uint32_t *positions = nullptr);
+
+    size_t size() const { return count_; }
+    bool empty() const { return count_ == 0; }
+    size_t byte_size() const { return bytes_.size() + positions_.size(); }
+    bool positional() const { return !positions_.empty(); }
+    uint64_t last_doc() const { return last_doc_; }
+    const std::vector<uint8_t> &bytes() const { return bytes_; }
+    const std::vector<PostingSkip> &skips() const { return skips_; }
+    const std::vector<uint8_t> &positions() const { return positions_; }
+    const std::vector<uint64_t> &position_blocks() const { return position_blocks_; }
+    PostingListView view() const {
+        return {bytes_.data(), skips_.data(), count_, positional() ? positions_.data() : nullptr,
+                position_blocks_.data()};
+    }
+
+private:
+    std::vector<uint8_t> bytes_;
+    std::vector<PostingSkip> skips_;
+    std::vector<uint8_t> positions_;
+    std::vector<uint64_t> position_blocks_;
+    size_t count_{0};
+    uint64_t last_doc_{0};
+};
+
+inline uint64_t read_varint(const uint8_t *&p) {
+    uint64_t v = *p & 0x7F;
+    if (!(*p++ & 0x80)) return v;
+    unsigned shift = 7;
+    while (true) {
+        uint8_t b = *p++;
+        v |= static_cast<uint64_t>(b & 0x7F) << shift;
+        if (!(b & 0x80)) return v;
+        shift += 7;
+    }
+}
+
+void write_varint(std::vector<uint8_t> &out, uint64_t v);
+void write_varint(std::string &out, uint64_t v);
+
+// Largest tf of the whole list, taken from the skip entries
+uint32_t max_tf(const PostingListView &list);
+
+// Forward decoder over a PostingListView with block-skipping advance()
+class PostingIterator {
+public:
+    PostingIterator() = default;
+    explicit PostingIterator(const PostingListView &list) : list_(list) {
+        if (list_.count) {
+            p_ = list_.bytes;
+            pos_p_ = list_.positions;
+            decode();
+        }
+    }
+
+    bool valid() const { return pos_ < list_.count; }
+    uint64_t doc() const { return doc_; }
+    uint32_t tf() const { return tf_; }
+    size_t size() const { return list_.count; }
+    const PostingListView &list() const { return list_; }
+    bool has_positions() const { return list_.positions != nullptr; }
+
+    // Token positions of the current posting (tf entries); decoded on demand
+    void positions(std::vector<uint32_t> &out) {
+        out.clear();
+        if (!pos_read_) {
+            for (; pos_pending_; --pos_pending_) {
+                while (*pos_p_++ & 0x80) {}
+            }
+            pos_read_ = true;
+        }
+        const uint8_t *p = pos_p_;
+        uint32_t at = 0;
+        for (uint32_t i = 0; i < tf_; ++i) {
+            at += static_cast<uint32_t>(read_varint(p));
+            out.push_back(at);
+        }
+    }
+
+    void next() {
+        pos_pending_ += tf_;
+        pos_read_ = false;
+        if (++pos_ < list_.count) decode();
+    }
+
+    // Skip entry of the block that would hold target, without decoding it;
+    // nullptr once target is past the end of the list
+    const PostingSkip *shallow_block(uint64_t target) const {
+        size_t blocks = list_.block_count();
+        size_t block = pos_ / kPostingBlockSize;
+        while (block < blocks && list_.skips[block].last_doc < target) ++block;
+        return block < blocks ? &list_.skips[block] : nullptr;
+    }
+
+    // Moves to the first posting with doc id >= target
+    void advance(uint64_t target) {
+        if (!valid() || doc_ >= target) return;
+        size_t block = pos_ / kPostingBlockSize;
+        if (list_.skips[block].last_doc < target) {
+            size_t blocks = list_.block_count();
+            do {
+                ++block;
+            } while (block < blocks && list_.skips[block].last_doc < target);
+            if (block == blocks) {
+                pos_ = list_.count;
+                return;
+            }
+            pos_ = block * kPostingBlockSize;
+            p_ = list_.bytes + list_.skips[block].offset;
+            if (list_.positions) pos_p_ = list_.positions + list_.position_blocks[block];
+            pos_pending_ = 0;
+            pos_read_ = false;
+            doc_ = list_.skips[block - 1].last_doc;
+            decode();
+        }
+        while (doc_ < target) next();
+    }
+
+private:
+    void decode() {
+        doc_ += read_varint(p_);
+        tf_ = static_cast<uint32_t>(read_varint(p_));
+    }
+
+    PostingListView list_;
+    const uint8_t *p_{nullptr};
+    size_t pos_{0};
+    uint64_t doc_{0};
+    uint32_t tf_{0};
+    // Position lists between pos_p_ and the current posting's positions
+    const uint8_t *pos_p_{nullptr};
+    uint64_t pos_pending_{0};
+    bool pos_read_{false};
+};
+
+// Union of lists; tf of a doc in several lists is summed, positions are dropped
+PostingList merge_postings(const std::vector<PostingListView> &lists);
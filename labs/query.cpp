@@ -0,0 +1,737 @@
+#include "query.hpp"
+#include "metrics.hpp"
+#include "query_parser.hpp"
+#include "term_dict.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+
+namespace {
+// Positional condition inside a conjunction. A phrase needs every term at its
+// offset from a common start; NEAR/k needs two terms at most slop positions apart.
+struct PositionConstraint {
+    enum Kind { Phrase, Near } kind{Phrase};
+    std::vector<size_t> terms;      // unique term ids, later iterator slots
+    std::vector<uint32_t> offsets;  // phrase only, ascending from 0
+    uint32_t slop{0};               // near only
+};
+
+bool phrase_matches(const std::vector<const std::vector<uint32_t> *> &lists, const std::vector<uint32_t> &offsets) {
+    const auto &first = *lists[0];
+    std::vector<size_t> at(lists.size(), 0);
+    size_t i = 0;
+    while (i < first.size()) {
+        uint32_t start = first[i];
+        bool matched = true;
+        for (size_t j = 1; j < lists.size(); ++j) {
+            const auto &pos = *lists[j];
+            uint32_t want = start + offsets[j];
+            while (at[j] < pos.size() && pos[at[j]] < want) ++at[j];
+            if (at[j] == pos.size()) return false;
+            if (pos[at[j]] != want) {
+                // No match can start before this term's next occurrence allows
+                uint32_t next_start = pos[at[j]] - offsets[j];
+                while (i < first.size() && first[i] < next_start) ++i;
+                matched = false;
+                break;
+            }
+        }
+        if (matched) return true;
+    }
+    return false;
+}
+
+bool near_matches(const std::vector<uint32_t> &a, const std::vector<uint32_t> &b, uint32_t slop) {
+    size_t i = 0, j = 0;
+    while (i < a.size() && j < b.size()) {
+        uint32_t gap = a[i] < b[j] ? b[j] - a[i] : a[i] - b[j];
+        if (gap <= slop) return true;
+        if (a[i] < b[j]) ++i;
+        else ++j;
+    }
+    return false;
+}
+
+constexpr uint64_t kNoDoc = UINT64_MAX;
+
+// Lazily evaluated node of a query plan; doc() is kNoDoc once exhausted
+class DocIterator {
+public:
+    virtual ~DocIterator() = default;
+
+    uint64_t doc() const { return doc_; }
+    bool exhausted() const { return doc_ == kNoDoc; }
+    void next() { advance(doc_ + 1); }
+
+    // Moves to the first match with doc id >= target; no-op if already there
+    virtual void advance(uint64_t target) = 0;
+    // Upper estimate of the number of matches, used to order intersections
+    virtual uint64_t cost() const = 0;
+
+protected:
+    uint64_t doc_{0};
+};
+
+using DocIteratorPtr = std::unique_ptr<DocIterator>;
+
+class EmptyDocs : public DocIterator {
+public:
+    EmptyDocs() { doc_ = kNoDoc; }
+    void advance(uint64_t) override {}
+    uint64_t cost() const override { return 0; }
+};
+
+// Leapfrog intersection of posting lists; iterators are ordered by ascending df.
+// Constraints refer to iterator slots; lists without positions skip them.
+// With a lead list (docs of all of the first `covered` slots, e.g. a cached
+// pair) that list leads instead, and the covered iterators only move when
+// positions are needed.
+using DocList = std::shared_ptr<const std::vector<uint64_t>>;
+
+class Conjunction : public DocIterator {
+public:
+    Conjunction(std::vector<PostingIterator> its, std::vector<PositionConstraint> constraints, DocList lead = nullptr,
+                size_t covered = 0)
+        : its_(std::move(its)), constraints_(std::move(constraints)), positions_(its_.size()), lead_(std::move(lead)),
+          covered_(lead_ ? covered : 0) {
+        seek(0);
+    }
+
+    void advance(uint64_t target) override {
+        if (doc_ < target) seek(target);
+    }
+    uint64_t cost() const override { return lead_ ? lead_->size() : its_[0].size(); }
+
+private:
+    bool lead_valid() const { return lead_ ? lead_pos_ < lead_->size() : its_[0].valid(); }
+    uint64_t lead_doc() const { return lead_ ? (*lead_)[lead_pos_] : its_[0].doc(); }
+    void lead_advance(uint64_t target) {
+        if (!lead_) {
+            its_[0].advance(target);
+            return;
+        }
+        auto from = lead_->begin() + static_cast<std::ptrdiff_t>(lead_pos_);
+        lead_pos_ = static_cast<size_t>(std::lower_bound(from, lead_->end(), target) - lead_->begin());
+    }
+
+    void seek(uint64_t target) {
+        lead_advance(target);
+        size_t first = lead_ ? covered_ : 1;
+        while (lead_valid()) {
+            uint64_t candidate = lead_doc();
+            bool matched = true;
+            for (size_t i = first; i < its_.size(); ++i) {
+                its_[i].advance(candidate);
+                if (!its_[i].valid()) {
+                    doc_ = kNoDoc;
+                    return;
+                }
+                if (its_[i].doc() > candidate) {
+                    lead_advance(its_[i].doc());
+                    matched = false;
+                    break;
+                }
+            }
+            if (matched) {
+                if (positions_match(candidate)) {
+                    doc_ = candidate;
+                    return;
+                }
+                lead_advance(candidate + 1);
+            }
+        }
+        doc_ = kNoDoc;
+    }
+
+    bool positions_match(uint64_t doc) {
+        if (constraints_.empty()) return true;
+        for (size_t i = 0; i < covered_; ++i) its_[i].advance(doc);
+        for (const auto &c : constraints_) {
+            bool positional = std::all_of(c.terms.begin(), c.terms.end(),
+                                          [this](size_t slot) { return its_[slot].has_positions(); });
+            if (!positional) continue;
+            std::vector<const std::vector<uint32_t> *> lists;
+            for (size_t slot : c.terms) {
+                its_[slot].positions(positions_[slot]);
+                lists.push_back(&positions_[slot]);
+            }
+            bool ok = c.kind == PositionConstraint::Phrase ? phrase_matches(lists, c.offsets)
+                                                           : near_matches(*lists[0], *lists[1], c.slop);
+            if (!ok) return false;
+        }
+        return true;
+    }
+
+    std::vector<PostingIterator> its_;
+    std::vector<PositionConstraint> constraints_;
+    std::vector<std::vector<uint32_t>> positions_;  // per slot, scratch
+    DocList lead_;
+    size_t covered_;
+    size_t lead_pos_{0};
+};
+
+// Leapfrog intersection of sub-plans, cheapest first
+class AndDocs : public DocIterator {
+public:
+    explicit AndDocs(std::vector<DocIteratorPtr> children) : children_(std::move(children)) {
+        std::sort(children_.begin(), children_.end(),
+                  [](const DocIteratorPtr &a, const DocIteratorPtr &b) { return a->cost() < b->cost(); });
+        seek(0);
+    }
+
+    void advance(uint64_t target) override {
+        if (doc_ < target) seek(target);
+    }
+    uint64_t cost() const override { return children_[0]->cost(); }
+
+private:
+    void seek(uint64_t target) {
+        while (target != kNoDoc) {
+            children_[0]->advance(target);
+            uint64_t candidate = children_[0]->doc();
+            target = candidate;
+            for (size_t i = 1; i < children_.size() && target == candidate; ++i) {
+                children_[i]->advance(candidate);
+                target = children_[i]->doc();
+            }
+            if (target == candidate) break;
+        }
+        doc_ = target;
+    }
+
+    std::vector<DocIteratorPtr> children_;
+};
+
+// Union of sub-plans through a min-heap of (doc, child) entries
+class OrDocs : public DocIterator {
+public:
+    explicit OrDocs(std::vector<DocIteratorPtr> children) : children_(std::move(children)) {
+        for (size_t i = 0; i < children_.size(); ++i) {
+            cost_ += children_[i]->cost();
+            if (!children_[i]->exhausted()) heap_.emplace_back(children_[i]->doc(), i);
+        }
+        std::make_heap(heap_.begin(), heap_.end(), std::greater<>());
+        doc_ = heap_.empty() ? kNoDoc : heap_.front().first;
+    }
+
+    void advance(uint64_t target) override {
+        while (!heap_.empty() && heap_.front().first < target) {
+            std::pop_heap(heap_.begin(), heap_.end(), std::greater<>());
+            DocIterator &child = *children_[heap_.back().second];
+            child.advance(target);
+            if (child.exhausted()) {
+                heap_.pop_back();
+            } else {
+                heap_.back().first = child.doc();
+                std::push_heap(heap_.begin(), heap_.end(), std::greater<>());
+            }
+        }
+        doc_ = heap_.empty() ? kNoDoc : heap_.front().first;
+    }
+    uint64_t cost() const override { return cost_; }
+
+private:
+    std::vector<DocIteratorPtr> children_;
+    std::vector<std::pair<uint64_t, size_t>> heap_;
+    uint64_t cost_{0};
+};
+
+// Matches of include that exclude does not match
+class AndNotDocs : public DocIterator {
+public:
+    AndNotDocs(DocIteratorPtr include, DocIteratorPtr exclude)
+        : include_(std::move(include)), exclude_(std::move(exclude)) {
+        seek(0);
+    }
+
+    void advance(uint64_t target) override {
+        if (doc_ < target) seek(target);
+    }
+    uint64_t cost() const override { return include_->cost(); }
+
+private:
+    void seek(uint64_t target) {
+        include_->advance(target);
+        while (!include_->exhausted()) {
+            uint64_t candidate = include_->doc();
+            exclude_->advance(candidate);
+            if (exclude_->doc() != candidate) break;
+            include_->next();
+        }
+        doc_ = include_->doc();
+    }
+
+    DocIteratorPtr include_;
+    DocIteratorPtr exclude_;
+};
+
+// Compiles a simplified query tree into iterators. Terms, phrases and NEAR
+// operands of one AND share a single Conjunction; other operands are
+// intersected cheapest first and NOT operands are subtracted from the result.
+// NOT outside an AND has nothing to subtract from and matches nothing.
+class Planner {
+public:
+    Planner(const std::vector<std::string> &terms, const std::vector<PostingListView> &lists,
+            const std::unordered_map<std::string, size_t> &ids, PairCache *pairs, DocSetCache *doc_sets)
+        : terms_(terms), lists_(lists), ids_(ids), pairs_(pairs), doc_sets_(doc_sets) {}
+
+    DocIteratorPtr build(const QueryNode &node) {
+        switch (node.kind) {
+            case QueryNode::Term:
+            case QueryNode::Pattern:
+            case QueryNode::Phrase:
+            case QueryNode::Near:
+                return build_and({&node}, {});
+            case QueryNode::And: {
+                std::vector<const QueryNode *> positive, negative;
+                for (const auto &child : node.children) {
+                    if (child.kind == QueryNode::Not) negative.push_back(&child.children[0]);
+                    else positive.push_back(&child);
+                }
+                return build_and(positive, negative);
+            }
+            case QueryNode::Or: {
+                std::vector<DocIteratorPtr> parts = build_live(node.children);
+                if (parts.empty()) return std::make_unique<EmptyDocs>();
+                if (parts.size() == 1) return std::move(parts[0]);
+                return std::make_unique<OrDocs>(std::move(parts));
+            }
+            case QueryNode::Not:
+                break;
+        }
+        return std::make_unique<EmptyDocs>();
+    }
+
+private:
+    template <typename Nodes>
+    std::vector<DocIteratorPtr> build_live(const Nodes &nodes) {
+        std::vector<DocIteratorPtr> parts;
+        for (const auto &node : nodes) {
+            DocIteratorPtr part = build(deref(node));
+            if (!part->exhausted()) parts.push_back(std::move(part));
+        }
+        return parts;
+    }
+    static const QueryNode &deref(const QueryNode &node) { return node; }
+    static const QueryNode &deref(const QueryNode *node) { return *node; }
+
+    DocIteratorPtr build_and(const std::vector<const QueryNode *> &positive,
+                             std::vector<const QueryNode *> negative) {
+        std::vector<size_t> terms;
+        std::vector<PositionConstraint> constraints;
+        std::vector<DocIteratorPtr> parts;
+        auto add_term = [&](const std::string &term) {
+            size_t id = ids_.at(term);
+            if (std::find(terms.begin(), terms.end(), id) == terms.end()) terms.push_back(id);
+            return id;
+        };
+        for (const QueryNode *node : positive) {
+            if (node->kind == QueryNode::Term || node->kind == QueryNode::Pattern) {
+                add_term(node->term);
+            } else if (node->kind == QueryNode::Phrase || node->kind == QueryNode::Near) {
+                PositionConstraint c;
+                c.kind = node->kind == QueryNode::Phrase ? PositionConstraint::Phrase : PositionConstraint::Near;
+                for (const auto &term : node->terms) c.terms.push_back(add_term(term));
+                c.offsets = node->offsets;
+                c.slop = node->slop;
+                constraints.push_back(std::move(c));
+            } else {
+                DocIteratorPtr part = build(*node);
+                if (part->exhausted()) return part;
+                parts.push_back(std::move(part));
+            }
+        }
+
+        if (!terms.empty()) {
+            for (size_t id : terms) {
+                if (lists_[id].empty()) return std::make_unique<EmptyDocs>();
+            }
+            std::sort(terms.begin(), terms.end(), [&](size_t a, size_t b) { return lists_[a].count < lists_[b].count; });
+            for (auto &c : constraints) {
+                for (size_t &t : c.terms) t = static_cast<size_t>(std::find(terms.begin(), terms.end(), t) - terms.begin());
+            }
+            std::vector<PostingIterator> its;
+            its.reserve(terms.size());
+            for (size_t id : terms) its.emplace_back(lists_[id]);
+            DocList lead;
+            size_t covered = 0;
+            if (dense(terms[0])) {
+                // Every term is dense: no list is short enough to lead a leapfrog, so
+                // intersect them chunk by chunk, subtracting dense NOT terms too
+                std::vector<size_t> excluded;
+                auto is_excluded = [&](const QueryNode *node) {
+                    if (node->kind != QueryNode::Term && node->kind != QueryNode::Pattern) return false;
+                    size_t id = ids_.at(node->term);
+                    if (!dense(id)) return false;
+                    excluded.push_back(id);
+                    return true;
+                };
+                negative.erase(std::remove_if(negative.begin(), negative.end(), is_excluded), negative.end());
+                if (terms.size() > 1 || !excluded.empty()) {
+                    lead = dense_docs(terms, excluded);
+                    covered = terms.size();
+                }
+            }
+            if (!lead && terms.size() > 1) {
+                lead = pair_docs(terms[0], terms[1]);
+                covered = 2;
+            }
+            parts.push_back(std::make_unique<Conjunction>(std::move(its), std::move(constraints), std::move(lead),
+                                                          covered));
+        }
+        if (parts.empty()) return std::make_unique<EmptyDocs>();
+        DocIteratorPtr include = parts.size() == 1 ? std::move(parts[0]) : std::make_unique<AndDocs>(std::move(parts));
+        if (include->exhausted()) return include;
+
+        std::vector<DocIteratorPtr> excludes = build_live(negative);
+        if (excludes.empty()) return include;
+        DocIteratorPtr exclude = excludes.size() == 1 ? std::move(excludes[0])
+                                                      : std::make_unique<OrDocs>(std::move(excludes));
+        return std::make_unique<AndNotDocs>(std::move(include), std::move(exclude));
+    }
+
+    // Lists this long hold at least one bitset chunk once turned into a DocSet
+    bool dense(size_t id) const { return lists_[id].count > DocSet::kArrayMax; }
+
+    std::shared_ptr<const DocSet> doc_set(size_t id) {
+        std::shared_ptr<const DocSet> set = doc_sets_ ? doc_sets_->find(terms_[id]) : nullptr;
+        if (set) return set;
+        set = std::make_shared<const DocSet>(DocSet::from_postings(lists_[id]));
+        if (doc_sets_) doc_sets_->insert(terms_[id], set, set->byte_size());
+        return set;
+    }
+
+    // Docs of every term in terms and of none in excluded, through DocSets.
+    // Cached with the pairs; the key is the sorted terms, excluded ones marked "!"
+    DocList dense_docs(const std::vector<size_t> &terms, const std::vector<size_t> &excluded) {
+        std::vector<std::string> parts;
+        for (size_t id : terms) parts.push_back(terms_[id]);
+        for (size_t id : excluded) parts.push_back("!" + terms_[id]);
+        std::sort(parts.begin(), parts.end());
+        std::string key;
+        for (const auto &part : parts) key.append(key.empty() ? "" : "\t").append(part);
+        DocList docs = pairs_ ? pairs_->find(key) : nullptr;
+        if (docs) return docs;
+
+        DocSet set = terms.size() > 1 ? intersect(*doc_set(terms[0]), *doc_set(terms[1])) : *doc_set(terms[0]);
+        for (size_t i = 2; i < terms.size() && !set.empty(); ++i) set = intersect(set, *doc_set(terms[i]));
+        for (size_t id : excluded) {
+            if (set.empty()) break;
+            set = subtract(set, *doc_set(id));
+        }
+        auto ids = std::make_shared<const std::vector<uint64_t>>(set.ids());
+        if (pairs_) pairs_->insert(key, ids, ids->size() * sizeof(uint64_t));
+        return ids;
+    }
+
+    // Docs containing both terms, from the pair cache or intersected and added to it
+    DocList pair_docs(size_t a, size_t b) {
+        if (!pairs_ || !pairs_->enabled()) return nullptr;
+        const std::string &first = std::min(terms_[a], terms_[b]);
+        const std::string &second = std::max(terms_[a], terms_[b]);
+        std::string key;
+        key.reserve(first.size() + second.size() + 1);
+        key.append(first).append(1, '\t').append(second);
+        DocList docs = pairs_->find(key);
+        if (docs) return docs;
+
+        auto both = std::make_shared<std::vector<uint64_t>>();
+        PostingIterator lead(lists_[a]), other(lists_[b]);
+        while (lead.valid()) {
+            other.advance(lead.doc());
+            if (!other.valid()) break;
+            if (other.doc() == lead.doc()) {
+                both->push_back(lead.doc());
+                lead.next();
+            } else {
+                lead.advance(other.doc());
+            }
+        }
+        both->shrink_to_fit();
+        pairs_->insert(key, both, both->size() * sizeof(uint64_t));
+        return both;
+    }
+
+    const std::vector<std::string> &terms_;
+    const std::vector<PostingListView> &lists_;
+    const std::unordered_map<std::string, size_t> &ids_;
+    PairCache *pairs_;
+    DocSetCache *doc_sets_;
+};
+
+// Registers every term of the tree once; scored marks terms seen outside NOT
+void collect_terms(const QueryNode &node, bool negated, std::vector<std::string> &terms,
+                   std::unordered_map<std::string, size_t> &ids, std::vector<bool> &scored) {
+    auto add = [&](const std::string &term) {
+        auto ins = ids.emplace(term, terms.size());
+        if (ins.second) {
+            terms.push_back(term);
+            scored.push_back(false);
+        }
+        if (!negated) scored[ins.first->second] = true;
+    };
+    switch (node.kind) {
+        case QueryNode::Term:
+        case QueryNode::Pattern:
+            add(node.term);
+            break;
+        case QueryNode::Phrase:
+        case QueryNode::Near:
+            for (const auto &term : node.terms) add(term);
+            break;
+        default:
+            for (const auto &child : node.children) {
+                collect_terms(child, negated != (node.kind == QueryNode::Not), terms, ids, scored);
+            }
+    }
+}
+
+// Float sums may land a rounding step above their bound; pruning keeps this margin
+constexpr double kBoundSlack = 1.0 + 1e-5;
+
+bool better_hit(const SearchHit &a, const SearchHit &b) {
+    if (a.score != b.score) return a.score > b.score;
+    return a.doc_id < b.doc_id;
+}
+
+// Collects hits in doc-id order; bounded to k entries when k > 0
+class TopK {
+public:
+    explicit TopK(size_t k) : k_(k) {}
+
+    // A new (larger) doc id must score strictly above this to be kept
+    float threshold() const { return k_ && heap_.size() == k_ ? heap_.front().score : 0.0f; }
+
+    void push(uint64_t doc_id, float score) {
+        if (!k_) {
+            heap_.push_back({doc_id, score});
+            return;
+        }
+        if (heap_.size() < k_) {
+            heap_.push_back({doc_id, score});
+            std::push_heap(heap_.begin(), heap_.end(), better_hit);
+        } else if (score > heap_.front().score) {
+            std::pop_heap(heap_.begin(), heap_.end(), better_hit);
+            heap_.back() = {doc_id, score};
+            std::push_heap(heap_.begin(), heap_.end(), better_hit);
+        }
+    }
+
+    std::vector<SearchHit> take_sorted() {
+        StageTimer timer(Stage::Sort);
+        std::sort(heap_.begin(), heap_.end(), better_hit);
+        return std::move(heap_);
+    }
+
+private:
+    size_t k_;
+    std::vector<SearchHit> heap_;
+};
+
+// Block-Max WAND over a disjunction of single terms
+std::vector<SearchHit> wand_top_k(const std::vector<PostingListView> &lists, const std::vector<float> &weights,
+                                  const Scorer &scorer, size_t k, const DocBitmap *deleted) {
+    struct Cursor {
+        PostingIterator it;
+        float weight;
+        double max_score;
+    };
+    std::vector<Cursor> cursors;
+    for (size_t i = 0; i < lists.size(); ++i) {
+        if (lists[i].empty()) continue;
+        double bound = scorer.upper_bound(weights[i], max_tf(lists[i])) * kBoundSlack;
+        cursors.push_back({PostingIterator(lists[i]), weights[i], bound});
+    }
+
+    TopK top(k);
+    uint64_t scored = 0, pruned = 0;
+    while (true) {
+        cursors.erase(std::remove_if(cursors.begin(), cursors.end(), [](const Cursor &c) { return !c.it.valid(); }),
+                      cursors.end());
+        if (cursors.empty()) break;
+        std::sort(cursors.begin(), cursors.end(), [](const Cursor &a, const Cursor &b) { return a.it.doc() < b.it.doc(); });
+
+        // Pivot: first doc whose accumulated per-term bound beats the threshold
+        double threshold = top.threshold();
+        double bound = 0;
+        size_t pivot = cursors.size();
+        for (size_t i = 0; i < cursors.size(); ++i) {
+            bound += cursors[i].max_score;
+            if (bound > threshold) {
+                pivot = i;
+                break;
+            }
+        }
+        if (pivot == cursors.size()) break;
+        uint64_t pivot_doc = cursors[pivot].it.doc();
+        while (pivot + 1 < cursors.size() && cursors[pivot + 1].it.doc() == pivot_doc) ++pivot;
+
+        // Refine with block maxima; if still too low, jump past the shortest block
+        double block_bound = 0;
+        uint64_t next_doc = pivot + 1 < cursors.size() ? cursors[pivot + 1].it.doc() : UINT64_MAX;
+        for (size_t i = 0; i <= pivot; ++i) {
+            const PostingSkip *skip = cursors[i].it.shallow_block(pivot_doc);
+            if (!skip) continue;
+            block_bound += scorer.upper_bound(cursors[i].weight, skip->max_tf) * kBoundSlack;
+            next_doc = std::min(next_doc, skip->last_doc + 1);
+        }
+        if (block_bound <= threshold) {
+            for (size_t i = 0; i <= pivot; ++i) cursors[i].it.advance(next_doc);
+            ++pruned;
+            continue;
+        }
+
+        if (cursors[0].it.doc() == pivot_doc) {
+            ++scored;
+            double score = 0;
+            for (size_t i = 0; i <= pivot; ++i) {
+                score += scorer.score(cursors[i].weight, cursors[i].it.tf(), pivot_doc);
+                cursors[i].it.next();
+            }
+            if (!deleted || !deleted->test(pivot_doc)) top.push(pivot_doc, static_cast<float>(score));
+        } else {
+            for (size_t i = 0; i <= pivot && cursors[i].it.doc() < pivot_doc; ++i) cursors[i].it.advance(pivot_doc);
+        }
+    }
+    add_counter(Counter::Candidates, scored + pruned);
+    add_counter(Counter::Scored, scored);
+    add_counter(Counter::Pruned, pruned);
+    return top.take_sorted();
+}
+}
+
+std::vector<SearchHit> run_boolean_query(const std::string &query, const PostingLookup &lookup, size_t k,
+                                         const DocBitmap *deleted, const Scorer *scorer) {
+    return run_query_tree(simplify_query(parse_query(query)), lookup, k, deleted, scorer);
+}
+
+std::vector<SearchHit> run_query_tree(const QueryNode &root, const PostingLookup &lookup, size_t k,
+                                      const DocBitmap *deleted, const Scorer *scorer, PairCache *pairs,
+                                      const PatternLookup &patterns, DocSetCache *doc_sets) {
+    add_counter(Counter::Queries);
+    std::optional<StageTimer> fetch_timer(Stage::PostingFetch);
+    // Look every distinct term up once; the plan refers to them by index
+    std::vector<std::string> unique_terms;
+    std::unordered_map<std::string, size_t> term_ids;
+    std::vector<bool> scored;
+    collect_terms(root, false, unique_terms, term_ids, scored);
+    std::vector<PostingListView> lists;
+    lists.reserve(unique_terms.size());
+    // Folded terms never contain wildcards, so the text tells patterns apart
+    std::vector<std::shared_ptr<const PostingList>> expanded;
+    for (const auto &term : unique_terms) {
+        if (!is_term_pattern(term)) {
+            lists.push_back(lookup(term));
+            continue;
+        }
+        std::shared_ptr<const PostingList> list = patterns ? patterns(term) : nullptr;
+        lists.push_back(list ? list->view() : PostingListView{});
+        if (list) expanded.push_back(std::move(list));
+    }
+
+    // Only terms outside NOT contribute to scores
+    static const Scorer tf_scorer;
+    if (!scorer) scorer = &tf_scorer;
+    std::vector<PostingListView> score_lists;
+    std::vector<float> weights;
+    for (size_t i = 0; i < lists.size(); ++i) {
+        if (!scored[i]) continue;
+        score_lists.push_back(lists[i]);
+        weights.push_back(scorer->weight(unique_terms[i], lists[i].count));
+    }
+
+    auto single_term = [](const QueryNode &node) {
+        return node.kind == QueryNode::Term || node.kind == QueryNode::Pattern;
+    };
+    bool pure_or = single_term(root) || (root.kind == QueryNode::Or && !root.children.empty() &&
+                                         std::all_of(root.children.begin(), root.children.end(), single_term));
+    fetch_timer.reset();
+    StageTimer match_timer(Stage::Match);
+    if (k && pure_or) return wand_top_k(score_lists, weights, *scorer, k, deleted);
+
+    DocIteratorPtr plan = Planner(unique_terms, lists, term_ids, pairs, doc_sets).build(root);
+
+    std::vector<PostingIterator> scorers;
+    scorers.reserve(score_lists.size());
+    for (const auto &list : score_lists) scorers.emplace_back(list);
+
+    TopK top(k);
+    uint64_t candidates = 0, pruned = 0;
+    for (; !plan->exhausted(); plan->next()) {
+        uint64_t doc = plan->doc();
+        if (deleted && deleted->test(doc)) continue;
+        ++candidates;
+
+        // Skip exact scoring when even the block maxima cannot beat the k-th hit
+        double threshold = top.threshold();
+        if (threshold > 0) {
+            double bound = 0;
+            for (size_t i = 0; i < scorers.size(); ++i) {
+                const PostingSkip *skip = scorers[i].shallow_block(doc);
+                if (skip) bound += scorer->upper_bound(weights[i], skip->max_tf) * kBoundSlack;
+            }
+            if (bound <= threshold) {
+                ++pruned;
+                continue;
+            }
+        }
+
+        double score = 0;
+        for (size_t i = 0; i < scorers.size(); ++i) {
+            PostingIterator &it = scorers[i];
+            it.advance(doc);
+            if (it.valid() && it.doc() == doc) score += scorer->score(weights[i], it.tf(), doc);
+        }
+        top.push(doc, static_cast<float>(score));
+    }
+    add_counter(Counter::Candidates, candidates);
+    add_counter(Counter::Scored, candidates - pruned);
+    add_counter(Counter::Pruned, pruned);
+
+    return top.take_sorted();
+}
+
+std::vector<SearchHit> cached_search(const std::string &query, size_t k, ResultCache &cache,
+                                     const std::function<std::vector<SearchHit>(const QueryNode &)> &evaluate) {
+    if (!cache.enabled()) return evaluate(simplify_query(parse_query(query)));
+    // Raw and normalized keys live in separate namespaces of the same cache
+    std::string suffix = "\n" + std::to_string(k);
+    std::string raw_key = "q" + query + suffix;
+    if (auto hits = cache.find(raw_key)) return *hits;
+
+    QueryNode root = simplify_query(parse_query(query));
+    std::string key = "n" + query_to_string(root) + suffix;
+    auto hits = cache.find(key);
+    if (!hits) {
+        hits = std::make_shared<const std::vector<SearchHit>>(evaluate(root));
+        cache.insert(key, hits, hits->size() * sizeof(SearchHit));
+    }
+    cache.insert(raw_key, hits, 0);
+    return *hits;
+}
+
+PostingList merge_pattern_postings(std::vector<PostingListView> matches) {
+    if (matches.size() > kMaxPatternTerms) {
+        // Stable, so equal df keeps the earlier term and every index cuts alike
+        std::stable_sort(matches.begin(), matches.end(),
+                         [](const PostingListView &a, const PostingListView &b) { return a.count > b.count; });
+        matches.resize(kMaxPatternTerms);
+    }
+    return merge_postings(matches);
+}
+
+std::vector<SearchHit> merge_hits(std::vector<std::vector<SearchHit>> parts, size_t k) {
+    StageTimer timer(Stage::Sort);
+    std::vector<SearchHit> hits;
+    for (auto &part : parts) hits.insert(hits.end(), part.begin(), part.end());
+    if (k && hits.size() > k) {
+        std::partial_sort(hits.begin(), hits.begin() + static_cast<std::ptrdiff_t>(k), hits.end(), better_hit);
+        hits.resize(k);
+    } else {
+        std::sort(hits.begin(), hits.end(), better_hit);
+    }
+    return hits;
+}
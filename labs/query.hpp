@@ -0,0 +1,88 @@
+#pragma once
+
+#include "doc_bitmap.hpp"
+#include "doc_set.hpp"
+#include "lru_cache.hpp"
+#include "postings.hpp"
+#include "query_parser.hpp"
+#include "ranking.hpp"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct SearchHit {
+    uint64_t doc_id;
+    float score;
+};
+
+// Returns postings of an already normalized term, empty view if the term is unknown
+using PostingLookup = std::function<PostingListView(const std::string &term)>;
+// Returns the union of the postings of every term matching a pattern (see
+// is_term_pattern); held by the caller for as long as it reads the list
+using PatternLookup = std::function<std::shared_ptr<const PostingList>(const std::string &pattern)>;
+
+// A pattern expands to at most this many terms, the ones with the largest df
+constexpr size_t kMaxPatternTerms = 256;
+
+using ResultCache = ShardedLru<std::vector<SearchHit>>;
+// Docs containing both terms of a pair, keyed by the two terms in sorted order
+using PairCache = ShardedLru<std::vector<uint64_t>>;
+// Expanded pattern postings, keyed by the folded pattern
+using PatternCache = ShardedLru<PostingList>;
+// Dense terms' postings as DocSets, keyed by term
+using DocSetCache = ShardedLru<DocSet>;
+
+// Caches owned by one index; thread-safe. The owner clears them whenever its
+// documents, tombstones or ranking change.
+struct QueryCache {
+    QueryCache(size_t result_bytes, size_t pair_bytes)
+        : results(result_bytes), pairs(pair_bytes), patterns(pair_bytes), doc_sets(pair_bytes) {}
+    void clear() {
+        results.clear();
+        pairs.clear();
+        patterns.clear();
+        doc_sets.clear();
+    }
+
+    ResultCache results;
+    PairCache pairs;
+    PatternCache patterns;
+    DocSetCache doc_sets;
+};
+
+// Evaluates boolean queries (grammar in query_parser.hpp) against any posting
+// source. The parsed tree is compiled into lazy iterators: conjunctions run
+// cheapest operand first, NOT operands are subtracted from their siblings.
+// Phrases and NEAR/k degrade to a plain AND on lists without positions.
+// With k > 0 only the k best hits are returned; pure OR queries then use
+// Block-Max WAND and skip documents that cannot enter the top k.
+// Docs set in deleted (tombstones) never match. Without a scorer the score is
+// the sum of tf over the query terms outside NOT.
+std::vector<SearchHit> run_boolean_query(const std::string &query, const PostingLookup &lookup, size_t k = 0,
+                                         const DocBitmap *deleted = nullptr, const Scorer *scorer = nullptr);
+
+// Same for a query already parsed and simplified. With pairs, conjunctions start
+// from the cached intersection of their two rarest terms and add new ones to it.
+// Pattern nodes are resolved through patterns and then act as one term (matching
+// nothing without a pattern lookup). Conjunctions of dense terms only (more
+// than DocSet::kArrayMax postings each) intersect them as DocSets, kept in
+// doc_sets when given.
+std::vector<SearchHit> run_query_tree(const QueryNode &root, const PostingLookup &lookup, size_t k = 0,
+                                      const DocBitmap *deleted = nullptr, const Scorer *scorer = nullptr,
+                                      PairCache *pairs = nullptr, const PatternLookup &patterns = {},
+                                      DocSetCache *doc_sets = nullptr);
+
+// Merges the postings of the terms a pattern matched, keeping only the
+// kMaxPatternTerms lists with the largest df
+PostingList merge_pattern_postings(std::vector<PostingListView> matches);
+
+// Returns cached hits when the query text, or failing that its normalized form,
+// was answered before with the same k. Otherwise calls evaluate on the parsed
+// tree and remembers the hits under both keys.
+std::vector<SearchHit> cached_search(const std::string &query, size_t k, ResultCache &cache,
+                                     const std::function<std::vector<SearchHit>(const QueryNode &)> &evaluate);
+
+// Merges per-segment hit lists into the k best overall (k == 0 keeps all)
+std::vector<SearchHit> merge_hits(std::vector<std::vector<SearchHit>> parts, size_t k);
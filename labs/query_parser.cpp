@@ -0,0 +1,356 @@
+#include "query_parser.hpp"
+#include "metrics.hpp"
+#include "stemmer.hpp"
+#include "term_dict.hpp"
+#include "tokenizer.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <unordered_set>
+
+namespace {
+struct Token {
+    enum Kind { Word, Phrase, Near, And, Or, Not, LParen, RParen, End };
+    Kind kind;
+    std::string text;
+    uint32_t slop{0};
+};
+
+bool is_special(char c) {
+    return c == '(' || c == ')' || c == '&' || c == '|' || c == '!' || c == '"';
+}
+
+std::vector<Token> lex(const std::string &q) {
+    std::vector<Token> tokens;
+    size_t i = 0;
+    while (i < q.size()) {
+        char c = q[i];
+        if (std::isspace(static_cast<unsigned char>(c))) {
+            ++i;
+        } else if (c == '(') {
+            tokens.push_back({Token::LParen, {}});
+            ++i;
+        } else if (c == ')') {
+            tokens.push_back({Token::RParen, {}});
+            ++i;
+        } else if (c == '&') {
+            tokens.push_back({Token::And, {}});
+            ++i;
+        } else if (c == '|') {
+            tokens.push_back({Token::Or, {}});
+            ++i;
+        } else if (c == '!' || c == '-') {
+            // '-' negates only at the start of an operand; inside a word it is a hyphen
+            tokens.push_back({Token::Not, {}});
+            ++i;
+        } else if (c == '"') {
+            size_t end = q.find('"', i + 1);
+            if (end == std::string::npos) end = q.size();
+            tokens.push_back({Token::Phrase, q.substr(i + 1, end - i - 1)});
+            i = std::min(end + 1, q.size());
+        } else {
+            size_t start = i;
+            while (i < q.size() && !std::isspace(static_cast<unsigned char>(q[i])) && !is_special(q[i])) ++i;
+            std::string word = q.substr(start, i - start);
+            if (word == "AND") {
+                tokens.push_back({Token::And, {}});
+            } else if (word == "OR") {
+                tokens.push_back({Token::Or, {}});
+            } else if (word == "NOT") {
+                tokens.push_back({Token::Not, {}});
+            } else if (word.rfind("NEAR/", 0) == 0) {
+                tokens.push_back({Token::Near, {}, static_cast<uint32_t>(std::strtoul(word.c_str() + 5, nullptr, 10))});
+            } else {
+                tokens.push_back({Token::Word, word});
+            }
+        }
+    }
+    tokens.push_back({Token::End, {}});
+    return tokens;
+}
+
+// Literal pieces are folded like index terms but not stemmed: the pattern is
+// matched against the stems in the dictionary as it is
+QueryNode make_pattern(const std::string &word) {
+    QueryNode node;
+    std::string pattern;
+    bool literal = false;
+    size_t start = 0;
+    while (start <= word.size()) {
+        size_t wild = std::min(word.size(), word.find_first_of("*?", start));
+        std::string piece = fold_token(std::string_view(word).substr(start, wild - start));
+        literal = literal || !piece.empty();
+        pattern += piece;
+        if (wild == word.size()) break;
+        // "**" is the same as "*"
+        if (word[wild] == '?' || pattern.empty() || pattern.back() != '*') pattern += word[wild];
+        start = wild + 1;
+    }
+    // A bare "*" would expand to the whole dictionary
+    if (!literal) return node;
+    node.kind = QueryNode::Pattern;
+    node.term = std::move(pattern);
+    return node;
+}
+
+// Tokenized like a document, so stopwords leave position gaps
+QueryNode make_phrase(const std::string &text) {
+    TermCounter counter;
+    counter.set_record_positions(true);
+    TokenizationStats unused;
+    tokenize_document(text, counter, unused);
+    std::vector<std::pair<uint32_t, std::string>> at;
+    for (uint32_t local = 0; local < counter.size(); ++local) {
+        std::string term(stem_view(counter.term(local)));
+        for (uint32_t pos : counter.positions(local)) at.emplace_back(pos, term);
+    }
+    QueryNode node;
+    if (at.empty()) return node;
+    std::sort(at.begin(), at.end());
+    if (at.size() == 1) {
+        node.kind = QueryNode::Term;
+        node.term = at[0].second;
+        return node;
+    }
+    node.kind = QueryNode::Phrase;
+    for (const auto &a : at) {
+        node.terms.push_back(a.second);
+        node.offsets.push_back(a.first - at.front().first);
+    }
+    return node;
+}
+
+// False for a word of delimiters only ("—", "«", "…"): it is no operand at all,
+// as it yields no token at index time
+bool make_term(const std::string &word, QueryNode &out) {
+    // A delimiter inside the word ends a token at index time too ("a.b", "москва—сити"):
+    // the pieces must occur together, as a phrase or, with wildcards, ANDed
+    std::vector<std::string> pieces = split_token(word, "*?");
+    if (pieces.empty()) return false;
+    if (pieces.size() > 1) {
+        if (std::none_of(pieces.begin(), pieces.end(), [](const std::string &p) { return is_term_pattern(p); })) {
+            out = make_phrase(word);
+            return true;
+        }
+        out = QueryNode{};
+        out.kind = QueryNode::And;
+        for (const auto &piece : pieces) {
+            QueryNode child = is_term_pattern(piece) ? make_pattern(piece) : make_phrase(piece);
+            if (child.kind != QueryNode::Or) out.children.push_back(std::move(child));
+        }
+        if (out.children.empty()) out = QueryNode{};
+        return true;
+    }
+    if (is_term_pattern(word)) {
+        out = make_pattern(word);
+        return true;
+    }
+    out = QueryNode{};
+    out.kind = QueryNode::Term;
+    out.term = normalize_term(word);
+    return true;
+}
+
+class Parser {
+public:
+    explicit Parser(const std::string &query) : tokens_(lex(query)) {}
+
+    QueryNode parse() {
+        QueryNode root = parse_or();
+        // A stray ')' splits the query; the parts are ANDed
+        while (peek() != Token::End) {
+            ++pos_;
+            QueryNode more = parse_or();
+            QueryNode both;
+            both.kind = QueryNode::And;
+            both.children = {std::move(root), std::move(more)};
+            root = std::move(both);
+        }
+        return root;
+    }
+
+private:
+    Token::Kind peek() const { return tokens_[pos_].kind; }
+
+    static bool starts_operand(Token::Kind kind) {
+        return kind == Token::Word || kind == Token::Phrase || kind == Token::LParen || kind == Token::Not;
+    }
+
+    QueryNode parse_or() {
+        QueryNode node;
+        node.kind = QueryNode::Or;
+        while (true) {
+            QueryNode part = parse_and();
+            if (!part.children.empty()) node.children.push_back(std::move(part));
+            if (peek() != Token::Or) break;
+            ++pos_;
+        }
+        return node;
+    }
+
+    QueryNode parse_and() {
+        QueryNode node;
+        node.kind = QueryNode::And;
+        while (true) {
+            while (peek() == Token::And || peek() == Token::Near) ++pos_;
+            if (!starts_operand(peek())) break;
+            QueryNode operand;
+            if (parse_unary(operand)) node.children.push_back(std::move(operand));
+        }
+        return node;
+    }
+
+    bool parse_unary(QueryNode &out) {
+        if (peek() == Token::Not) {
+            ++pos_;
+            QueryNode inner;
+            if (!parse_unary(inner)) return false;
+            out.kind = QueryNode::Not;
+            out.children.push_back(std::move(inner));
+            return true;
+        }
+        return parse_near(out);
+    }
+
+    // "a NEAR/k b NEAR/m c" links each pair of neighbours; non-terms are ANDed
+    bool parse_near(QueryNode &out) {
+        QueryNode first;
+        if (!parse_primary(first)) return false;
+        if (peek() != Token::Near) {
+            out = std::move(first);
+            return true;
+        }
+        std::vector<QueryNode> operands;
+        operands.push_back(std::move(first));
+        QueryNode chain;
+        chain.kind = QueryNode::And;
+        while (peek() == Token::Near) {
+            uint32_t slop = tokens_[pos_++].slop;
+            QueryNode next;
+            if (!parse_primary(next)) break;
+            const QueryNode &prev = operands.back();
+            if (prev.kind == QueryNode::Term && next.kind == QueryNode::Term && prev.term != next.term) {
+                QueryNode near;
+                near.kind = QueryNode::Near;
+                near.terms = {prev.term, next.term};
+                near.slop = slop;
+                chain.children.push_back(std::move(near));
+            }
+            operands.push_back(std::move(next));
+        }
+        for (auto &op : operands) chain.children.push_back(std::move(op));
+        out = std::move(chain);
+        return true;
+    }
+
+    bool parse_primary(QueryNode &out) {
+        switch (peek()) {
+            case Token::LParen:
+                ++pos_;
+                out = parse_or();
+                if (peek() == Token::RParen) ++pos_;
+                return true;
+            case Token::Phrase:
+                out = make_phrase(tokens_[pos_++].text);
+                return true;
+            case Token::Word:
+                return make_term(tokens_[pos_++].text, out);
+            default:
+                return false;
+        }
+    }
+
+    std::vector<Token> tokens_;
+    size_t pos_{0};
+};
+
+bool matches_nothing(const QueryNode &node) {
+    return node.kind == QueryNode::Or && node.children.empty();
+}
+}
+
+QueryNode parse_query(const std::string &query) {
+    StageTimer timer(Stage::QueryParse);
+    return Parser(query).parse();
+}
+
+QueryNode simplify_query(QueryNode node) {
+    switch (node.kind) {
+        case QueryNode::Term:
+        case QueryNode::Pattern:
+        case QueryNode::Phrase:
+        case QueryNode::Near:
+            return node;
+        case QueryNode::Not: {
+            QueryNode child = simplify_query(std::move(node.children[0]));
+            if (child.kind == QueryNode::Not) return std::move(child.children[0]);
+            node.children[0] = std::move(child);
+            return node;
+        }
+        case QueryNode::And:
+        case QueryNode::Or:
+            break;
+    }
+
+    bool is_and = node.kind == QueryNode::And;
+    std::vector<QueryNode> flat;
+    for (auto &raw : node.children) {
+        QueryNode child = simplify_query(std::move(raw));
+        if (matches_nothing(child)) {
+            if (is_and) return QueryNode{};
+            continue;
+        }
+        // NOT of nothing excludes nothing
+        if (is_and && child.kind == QueryNode::Not && matches_nothing(child.children[0])) continue;
+        if (child.kind == node.kind) {
+            for (auto &grand : child.children) flat.push_back(std::move(grand));
+        } else {
+            flat.push_back(std::move(child));
+        }
+    }
+
+    std::unordered_set<std::string> seen;
+    std::vector<QueryNode> unique;
+    for (auto &child : flat) {
+        if (seen.insert(query_to_string(child)).second) unique.push_back(std::move(child));
+    }
+    if (unique.empty()) return QueryNode{};
+    if (unique.size() == 1) return std::move(unique[0]);
+    node.children = std::move(unique);
+    return node;
+}
+
+std::string query_to_string(const QueryNode &node) {
+    switch (node.kind) {
+        case QueryNode::Term:
+        case QueryNode::Pattern:
+            return node.term;
+        case QueryNode::Phrase: {
+            std::string out = "\"";
+            for (size_t i = 0; i < node.terms.size(); ++i) {
+                if (i) {
+                    out += ' ';
+                    // "_" marks a skipped position (a stopword)
+                    for (uint32_t gap = node.offsets[i - 1] + 1; gap < node.offsets[i]; ++gap) out += "_ ";
+                }
+                out += node.terms[i];
+            }
+            return out + "\"";
+        }
+        case QueryNode::Near:
+            return node.terms[0] + " NEAR/" + std::to_string(node.slop) + " " + node.terms[1];
+        case QueryNode::Not:
+            return "!" + query_to_string(node.children[0]);
+        case QueryNode::And:
+        case QueryNode::Or:
+            break;
+    }
+    if (node.children.empty()) return "()";
+    std::string out = "(";
+    for (size_t i = 0; i < node.children.size(); ++i) {
+        if (i) out += node.kind == QueryNode::And ? " & " : " | ";
+        out += query_to_string(node.children[i]);
+    }
+    return out + ")";
+}
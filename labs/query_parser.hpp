@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Query language (& binds tighter than |; adjacent operands are ANDed):
+//   a & b, a AND b, a b     conjunction
+//   a | b, a OR b           disjunction
+//   !a, -a, NOT a           exclusion; only meaningful next to a positive operand
+//   ( ... )                 grouping
+//   "a b c"                 phrase
+//   a NEAR/k b              both terms at most k positions apart
+//   моск*, м?ск             any dictionary term matching the pattern ('*' any run,
+//                           '?' one character); matched against stems, not stemmed
+// Parsing is lenient: stray operators and unbalanced parentheses are ignored.
+struct QueryNode {
+    enum Kind { Term, Pattern, Phrase, Near, And, Or, Not };
+
+    Kind kind{Or};                    // an empty Or matches nothing
+    std::string term;                 // Term: normalized term; Pattern: folded pattern
+    std::vector<std::string> terms;   // Phrase, Near: normalized terms
+    std::vector<uint32_t> offsets;    // Phrase: position of each term, ascending from 0
+    uint32_t slop{0};                 // Near
+    std::vector<QueryNode> children;  // And, Or, Not (one child)
+};
+
+QueryNode parse_query(const std::string &query);
+
+// Flattens nested And/Or, removes duplicate children and double negation,
+// and unwraps single-child groups
+QueryNode simplify_query(QueryNode node);
+
+// Canonical text form, e.g. (a & !"b c"); equal for equal trees
+std::string query_to_string(const QueryNode &node);
@@ -0,0 +1,306 @@
+#include "query_server.hpp"
+#include "loader.hpp"
+#include "worker_pool.hpp"
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace {
+// Unanswered requests per connection before reading from it pauses
+constexpr size_t kMaxPipelined = 1024;
+constexpr size_t kMaxLineBytes = 1 << 20;
+
+std::atomic<bool> stop_requested{false};
+
+void on_stop_signal(int) {
+    stop_requested = true;
+}
+
+struct Reply {
+    std::string text;
+    bool ready{false};
+};
+
+// Replies leave in request order: a finished reply waits until all earlier ones are sent.
+// The socket closes once the reader and every in-flight request let go of it.
+struct Connection {
+    explicit Connection(int fd) : fd(fd) {}
+    ~Connection() { close(fd); }
+
+    int fd;
+    std::mutex mu;
+    std::condition_variable space_cv;
+    std::deque<std::shared_ptr<Reply>> replies;
+    bool broken{false};  // peer gone; replies are dropped
+};
+
+bool send_all(int fd, const std::string &data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+void complete(Connection &conn, Reply &reply, std::string text) {
+    std::lock_guard<std::mutex> lock(conn.mu);
+    reply.text = std::move(text);
+    reply.ready = true;
+    while (!conn.replies.empty() && conn.replies.front()->ready) {
+        if (!conn.broken) conn.broken = !send_all(conn.fd, conn.replies.front()->text);
+        conn.replies.pop_front();
+    }
+    conn.space_cv.notify_all();
+}
+
+void append_json_string(std::string &out, std::string_view s) {
+    out += '"';
+    for (char c : s) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char buf[8];
+                    std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out += buf;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    out += '"';
+}
+
+std::string answer(std::string_view line, const ServerOptions &options, const SearchFunction &search,
+                   const DocLookup &doc_lookup, const SnippetLookup &snippets) {
+    std::string query;
+    std::string id;  // raw JSON value echoed back
+    size_t limit = options.default_limit;
+    size_t first = line.find_first_not_of(" \t");
+    if (first != std::string_view::npos && line[first] == '{') {
+        for_each_json_field(line, [&](std::string_view key, std::string_view value, bool is_string) {
+            if (key == "q" && is_string) {
+                query.assign(value.data(), value.size());
+            } else if (key == "id") {
+                id.clear();
+                if (is_string) append_json_string(id, value);
+                else id.assign(value.data(), value.size());
+            } else if (key == "limit" && !is_string) {
+                size_t n = std::strtoull(std::string(value).c_str(), nullptr, 10);
+                if (n) limit = std::min(n, options.max_limit);
+            }
+        });
+    } else {
+        query.assign(line.data(), line.size());
+    }
+
+    std::string out = "{";
+    if (!id.empty()) out += "\"id\":" + id + ",";
+    if (query.find_first_not_of(" \t") == std::string::npos) {
+        out += "\"error\":\"empty query\"}\n";
+        return out;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<SearchHit> hits = search(query, limit);
+    auto took = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+    out += "\"count\":" + std::to_string(hits.size()) + ",\"took_us\":" + std::to_string(took.count()) + ",\"hits\":[";
+    for (size_t i = 0; i < hits.size(); ++i) {
+        char score[32];
+        std::snprintf(score, sizeof(score), "%.6g", hits[i].score);
+        if (i) out += ',';
+        out += "{\"doc\":" + std::to_string(hits[i].doc_id) + ",\"score\":" + score;
+        DocRef doc = doc_lookup(hits[i].doc_id);
+        out += ",\"title\":";
+        append_json_string(out, doc.title);
+        out += ",\"url\":";
+        append_json_string(out, doc.url);
+        if (snippets) {
+            out += ",\"snippet\":";
+            append_json_string(out, snippets(query, hits[i].doc_id));
+        }
+        out += '}';
+    }
+    out += "]}\n";
+    return out;
+}
+
+// Reads request lines until EOF and queues each on the pool
+void read_requests(const std::shared_ptr<Connection> &conn, WorkerPool &pool, const ServerOptions &options,
+                   const SearchFunction &search, const DocLookup &doc_lookup, const SnippetLookup &snippets) {
+    std::string input;
+    char buf[1 << 16];
+    while (true) {
+        ssize_t n = recv(conn->fd, buf, sizeof(buf), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        input.append(buf, static_cast<size_t>(n));
+
+        size_t start = 0;
+        size_t nl;
+        while ((nl = input.find('\n', start)) != std::string::npos) {
+            std::string line = input.substr(start, nl - start);
+            start = nl + 1;
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line.empty()) continue;
+
+            auto reply = std::make_shared<Reply>();
+            {
+                std::unique_lock<std::mutex> lock(conn->mu);
+                conn->space_cv.wait(lock, [&]() { return conn->broken || conn->replies.size() < kMaxPipelined; });
+                if (conn->broken) return;
+                conn->replies.push_back(reply);
+            }
+            pool.submit([conn, reply, line = std::move(line), &options, &search, &doc_lookup, &snippets]() {
+                complete(*conn, *reply, answer(line, options, search, doc_lookup, snippets));
+            });
+        }
+        input.erase(0, start);
+        if (input.size() > kMaxLineBytes) return;
+    }
+}
+
+// Returns a listening socket, or -1 after reporting the error
+int open_listener(const std::string &address) {
+    if (address.rfind("unix:", 0) == 0) {
+        std::string path = address.substr(5);
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+            std::cerr << "Bad unix socket path: " << path << "\n";
+            return -1;
+        }
+        std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+        unlink(path.c_str());
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0 && bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0 && listen(fd, 128) == 0) {
+            return fd;
+        }
+        std::cerr << "Cannot listen on " << address << ": " << std::strerror(errno) << "\n";
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+
+    std::string host = "127.0.0.1";
+    std::string port = address;
+    size_t colon = address.rfind(':');
+    if (colon != std::string::npos) {
+        host = address.substr(0, colon);
+        port = address.substr(colon + 1);
+    }
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    addrinfo *found = nullptr;
+    int rc = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &found);
+    if (rc != 0) {
+        std::cerr << "Cannot resolve " << address << ": " << gai_strerror(rc) << "\n";
+        return -1;
+    }
+    int fd = -1;
+    for (addrinfo *ai = found; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) continue;
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, 128) == 0) break;
+        close(fd);
+        fd = -1;
+    }
+    if (fd < 0) std::cerr << "Cannot listen on " << address << ": " << std::strerror(errno) << "\n";
+    freeaddrinfo(found);
+    return fd;
+}
+
+struct Session {
+    std::shared_ptr<Connection> conn;
+    std::thread reader;
+    std::atomic<bool> finished{false};
+};
+}
+
+bool serve_queries(const ServerOptions &options, const SearchFunction &search, const DocLookup &doc_lookup,
+                   const SnippetLookup &snippets) {
+    int listener = open_listener(options.address);
+    if (listener < 0) return false;
+
+    stop_requested = false;
+    struct sigaction action{};
+    action.sa_handler = on_stop_signal;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    std::cout << "[INFO] Serving queries on " << options.address << " with " << options.threads
+              << " workers" << std::endl;
+
+    WorkerPool pool(options.threads);
+    std::list<Session> sessions;
+    auto reap = [&]() {
+        for (auto it = sessions.begin(); it != sessions.end();) {
+            if (!it->finished) {
+                ++it;
+                continue;
+            }
+            it->reader.join();
+            it = sessions.erase(it);
+        }
+    };
+
+    // Poll with a timeout so a stop signal is noticed even when no client connects
+    while (!stop_requested) {
+        pollfd pfd{listener, POLLIN, 0};
+        int ready = poll(&pfd, 1, 200);
+        reap();
+        if (ready <= 0) continue;
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0) continue;
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        Session &session = sessions.emplace_back();
+        session.conn = std::make_shared<Connection>(fd);
+        session.reader = std::thread([&session, &pool, &options, &search, &doc_lookup, &snippets]() {
+            read_requests(session.conn, pool, options, search, doc_lookup, snippets);
+            session.finished = true;
+        });
+    }
+
+    close(listener);
+    if (options.address.rfind("unix:", 0) == 0) unlink(options.address.c_str() + 5);
+    // Stop reading; requests already queued are still answered before the pool exits
+    for (auto &session : sessions) shutdown(session.conn->fd, SHUT_RD);
+    for (auto &session : sessions) session.reader.join();
+    sessions.clear();
+    std::cout << "[INFO] Server stopped" << std::endl;
+    return true;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "mapped_index.hpp"
+#include "query.hpp"
+
+#include <functional>
+#include <string>
+
+struct ServerOptions {
+    std::string address;       // "unix:/path", "host:port" or a bare port on 127.0.0.1
+    size_t threads{1};         // query workers shared by all connections
+    size_t default_limit{10};  // hits per response when the request has no limit
+    size_t max_limit{1000};
+};
+
+// Both are called concurrently from the workers, so the index behind them must
+// not change while the server runs
+using SearchFunction = std::function<std::vector<SearchHit>(const std::string &query, size_t k)>;
+using DocLookup = std::function<DocRef(uint64_t id)>;
+// Highlighted text of a hit for the query; may be empty
+using SnippetLookup = std::function<std::string(const std::string &query, uint64_t id)>;
+
+// Serves queries until SIGINT/SIGTERM. Every request is one line: a raw query,
+// or a JSON object {"id": any, "q": "query", "limit": N}. Every request gets
+// one JSON line back, {"id":..,"count":..,"took_us":..,"hits":[{"doc","score",
+// "title","url"}]} or {"id":..,"error":".."}, in request order, so clients may
+// pipeline many requests without waiting. Hits also carry a "snippet" when a
+// snippet lookup is given. Returns false if the socket cannot be bound.
+bool serve_queries(const ServerOptions &options, const SearchFunction &search, const DocLookup &doc_lookup,
+                   const SnippetLookup &snippets = {});
@@ -0,0 +1,56 @@
+#include "ranking.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+bool parse_ranking_mode(const std::string &name, RankingMode &mode) {
+    if (name == "tf") mode = RankingMode::Tf;
+    else if (name == "tfidf") mode = RankingMode::TfIdf;
+    else if (name == "bm25") mode = RankingMode::Bm25;
+    else return false;
+    return true;
+}
+
+Scorer::Scorer(const RankingParams &params, const CollectionStats &stats, DocLengthsView lengths, DfLookup global_df)
+    : params_(params), doc_count_(stats.doc_count), lengths_(lengths), global_df_(std::move(global_df)) {
+    double avg = stats.avg_length();
+    k1_plus_1_ = params.k1 + 1.0f;
+    norm_base_ = params.k1 * (1.0f - params.b);
+    norm_per_token_ = avg > 0 ? static_cast<float>(params.k1 * params.b / avg) : 0.0f;
+}
+
+float Scorer::weight(const std::string &term, uint64_t local_df) const {
+    double n = static_cast<double>(doc_count_);
+    double df = static_cast<double>(global_df_ ? global_df_(term) : local_df);
+    switch (params_.mode) {
+        case RankingMode::Tf:
+            return 1.0f;
+        case RankingMode::TfIdf:
+            // Lucene classic idf; stays positive even when every doc has the term
+            return static_cast<float>(1.0 + std::log(n / (df + 1.0)));
+        case RankingMode::Bm25:
+        default:
+            return static_cast<float>(std::log(1.0 + (n - df + 0.5) / (df + 0.5)));
+    }
+}
+
+float Scorer::tf_root(uint32_t tf) {
+    return std::sqrt(static_cast<float>(tf));
+}
+
+float Scorer::inv_sqrt_length(uint64_t doc) const {
+    return 1.0f / std::sqrt(static_cast<float>(std::max<uint32_t>(lengths_[doc], 1)));
+}
+
+float Scorer::upper_bound(float weight, uint32_t max_tf) const {
+    // Length is unknown per block, so assume the shortest possible document
+    switch (params_.mode) {
+        case RankingMode::Tf:
+            return static_cast<float>(max_tf);
+        case RankingMode::TfIdf:
+            return weight * tf_root(max_tf);
+        case RankingMode::Bm25:
+        default:
+            return weight * max_tf * k1_plus_1_ / (max_tf + norm_base_);
+    }
+}
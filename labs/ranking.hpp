@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+enum class RankingMode { Tf, TfIdf, Bm25 };
+
+struct RankingParams {
+    RankingMode mode{RankingMode::Bm25};
+    float k1{1.2f};
+    float b{0.75f};
+};
+
+// "tf", "tfidf", "bm25"; returns false for anything else
+bool parse_ranking_mode(const std::string &name, RankingMode &mode);
+
+// Collection-wide numbers behind idf and length normalization
+struct CollectionStats {
+    uint64_t doc_count{0};
+    uint64_t total_length{0};  // tokens over all docs
+
+    double avg_length() const { return doc_count ? static_cast<double>(total_length) / doc_count : 0.0; }
+};
+
+// Token count per document for ids first_id .. first_id + count - 1
+struct DocLengthsView {
+    const uint32_t *data{nullptr};
+    uint64_t first_id{1};
+    size_t count{0};
+
+    uint32_t operator[](uint64_t id) const {
+        uint64_t i = id - first_id;
+        return i < count ? data[i] : 0;
+    }
+};
+
+// Document frequency of a normalized term across the whole collection
+using DfLookup = std::function<uint64_t(const std::string &term)>;
+
+// Scores one index's postings. A query computes weight() once per term, then
+// score() per posting. The default scorer sums raw tf.
+class Scorer {
+public:
+    Scorer() { params_.mode = RankingMode::Tf; }
+    Scorer(const RankingParams &params, const CollectionStats &stats, DocLengthsView lengths,
+           DfLookup global_df = nullptr);
+
+    // local_df is the term's postings count in this index; global_df overrides it
+    float weight(const std::string &term, uint64_t local_df) const;
+
+    float score(float weight, uint32_t tf, uint64_t doc) const {
+        switch (params_.mode) {
+            case RankingMode::Tf:
+                return static_cast<float>(tf);
+            case RankingMode::TfIdf:
+                return weight * tf_root(tf) * inv_sqrt_length(doc);
+            case RankingMode::Bm25:
+            default:
+                return weight * tf * k1_plus_1_ / (tf + norm_base_ + norm_per_token_ * lengths_[doc]);
+        }
+    }
+
+    // Never below score(weight, tf, doc) for tf <= max_tf and any doc
+    float upper_bound(float weight, uint32_t max_tf) const;
+
+private:
+    RankingParams params_;
+    uint64_t doc_count_{0};
+    DocLengthsView lengths_;
+    DfLookup global_df_;
+    // BM25 length norm is norm_base_ + norm_per_token_ * length
+    float k1_plus_1_{0};
+    float norm_base_{0};
+    float norm_per_token_{0};
+
+    static float tf_root(uint32_t tf);
+    float inv_sqrt_length(uint64_t doc) const;
+};
@@ -0,0 +1,189 @@
+#include "segment_writer.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+namespace {
+void write_padding(std::ofstream &out, uint64_t &pos) {
+    static const char zeros[8] = {};
+    uint64_t aligned = segment::align8(pos);
+    out.write(zeros, static_cast<std::streamsize>(aligned - pos));
+    pos = aligned;
+}
+
+template <typename T>
+void write_pod(std::ofstream &out, const T &value, uint64_t &pos) {
+    out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+    pos += sizeof(T);
+}
+
+void append_file(std::ofstream &out, const std::string &path, uint64_t &pos) {
+    std::ifstream in(path, std::ios::binary);
+    std::vector<char> buf(1 << 20);
+    while (in) {
+        in.read(buf.data(), static_cast<std::streamsize>(buf.size()));
+        std::streamsize got = in.gcount();
+        if (got <= 0) break;
+        out.write(buf.data(), got);
+        pos += static_cast<uint64_t>(got);
+    }
+}
+}
+
+SegmentWriter::~SegmentWriter() {
+    remove_side_files();
+}
+
+void SegmentWriter::remove_side_files() {
+    if (path_.empty()) return;
+    skips_out_.close();
+    postings_out_.close();
+    position_blocks_out_.close();
+    positions_out_.close();
+    std::remove((path_ + ".skips.tmp").c_str());
+    std::remove((path_ + ".postings.tmp").c_str());
+    std::remove((path_ + ".position_blocks.tmp").c_str());
+    std::remove((path_ + ".positions.tmp").c_str());
+}
+
+bool SegmentWriter::open(const std::string &path) {
+    path_ = path;
+    skips_out_.open(path + ".skips.tmp", std::ios::binary | std::ios::trunc);
+    postings_out_.open(path + ".postings.tmp", std::ios::binary | std::ios::trunc);
+    position_blocks_out_.open(path + ".position_blocks.tmp", std::ios::binary | std::ios::trunc);
+    positions_out_.open(path + ".positions.tmp", std::ios::binary | std::ios::trunc);
+    if (!skips_out_ || !postings_out_ || !position_blocks_out_ || !positions_out_) {
+        std::cerr << "Cannot write index file: " << path << "\n";
+        return false;
+    }
+    return true;
+}
+
+void SegmentWriter::add_term(std::string_view term, uint64_t cf, uint32_t df, const PostingList &postings) {
+    segment::TermEntry entry{};
+    entry.str_off = term_strings_.size();
+    entry.str_len = static_cast<uint32_t>(term.size());
+    entry.df = df;
+    entry.cf = cf;
+    entry.skips_off = skip_count_;
+    entry.postings_off = posting_bytes_;
+    entry.postings_count = postings.size();
+    entry.position_blocks_off = position_block_count_;
+    entry.positions_off = position_bytes_;
+    terms_.push_back(entry);
+    term_strings_ += term;
+
+    const auto &skips = postings.skips();
+    skips_out_.write(reinterpret_cast<const char *>(skips.data()),
+                     static_cast<std::streamsize>(skips.size() * sizeof(PostingSkip)));
+    const auto &bytes = postings.bytes();
+    postings_out_.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    skip_count_ += skips.size();
+    posting_bytes_ += bytes.size();
+
+    positional_ = positional_ && postings.positional();
+    if (positional_) {
+        const auto &blocks = postings.position_blocks();
+        position_blocks_out_.write(reinterpret_cast<const char *>(blocks.data()),
+                                   static_cast<std::streamsize>(blocks.size() * sizeof(uint64_t)));
+        const auto &positions = postings.positions();
+        positions_out_.write(reinterpret_cast<const char *>(positions.data()),
+                             static_cast<std::streamsize>(positions.size()));
+        position_block_count_ += blocks.size();
+        position_bytes_ += positions.size();
+    }
+}
+
+bool SegmentWriter::finish(const std::vector<Document> &docs, const std::vector<uint32_t> &doc_lengths,
+                           const TokenizationStats &stats) {
+    return finish(docs.size(), [&docs](size_t i, Document &meta) { meta = docs[i]; }, doc_lengths, stats);
+}
+
+bool SegmentWriter::finish(size_t doc_count, const DocMetadata &docs, const std::vector<uint32_t> &doc_lengths,
+                           const TokenizationStats &stats) {
+    skips_out_.close();
+    postings_out_.close();
+    position_blocks_out_.close();
+    positions_out_.close();
+    // A list without positions makes the whole segment non-positional
+    if (!positional_ || terms_.empty()) {
+        positional_ = false;
+        position_block_count_ = 0;
+        position_bytes_ = 0;
+        for (auto &entry : terms_) entry.position_blocks_off = entry.positions_off = 0;
+    }
+
+    segment::SegmentHeader header{};
+    std::memcpy(header.magic, segment::kMagic, sizeof(segment::kMagic));
+    header.version = segment::kVersion;
+    header.flags = positional_ ? segment::kFlagPositional : 0;
+    header.term_count = terms_.size();
+    header.doc_count = doc_count;
+    header.stat_docs = stats.docs;
+    header.stat_tokens = stats.tokens;
+    header.stat_token_chars = stats.token_chars;
+    header.stat_bytes_in = stats.bytes_in;
+    for (uint32_t len : doc_lengths) header.total_doc_length += len;
+
+    header.terms_off = segment::align8(sizeof(header));
+    header.term_strings_off = header.terms_off + terms_.size() * sizeof(segment::TermEntry);
+    header.skips_off = segment::align8(header.term_strings_off + term_strings_.size());
+    header.position_blocks_off = header.skips_off + skip_count_ * sizeof(PostingSkip);
+    header.postings_off = header.position_blocks_off + position_block_count_ * sizeof(uint64_t);
+    header.positions_off = header.postings_off + posting_bytes_;
+    header.docs_off = segment::align8(header.positions_off + position_bytes_);
+
+    // First pass over the metadata sizes the doc table, the second writes the strings
+    std::vector<segment::DocEntry> entries(doc_count);
+    Document meta;
+    uint64_t doc_bytes = 0;
+    for (size_t i = 0; i < doc_count; ++i) {
+        docs(i, meta);
+        segment::DocEntry &entry = entries[i];
+        entry.id = meta.id;
+        entry.str_off = doc_bytes;
+        entry.source_len = static_cast<uint32_t>(meta.source.size());
+        entry.url_len = static_cast<uint32_t>(meta.url.size());
+        entry.title_len = static_cast<uint32_t>(meta.title.size());
+        doc_bytes += meta.source.size() + meta.url.size() + meta.title.size();
+    }
+    uint64_t length_slots = entries.empty() ? 0 : entries.back().id - entries.front().id + 1;
+    header.doc_lengths_off = header.docs_off + doc_count * sizeof(segment::DocEntry);
+    header.doc_strings_off = segment::align8(header.doc_lengths_off + length_slots * sizeof(uint32_t));
+    header.file_size = segment::align8(header.doc_strings_off + doc_bytes);
+
+    std::ofstream out(path_, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        std::cerr << "Cannot write index file: " << path_ << "\n";
+        return false;
+    }
+
+    uint64_t pos = 0;
+    write_pod(out, header, pos);
+    write_padding(out, pos);
+    for (const auto &entry : terms_) write_pod(out, entry, pos);
+    out.write(term_strings_.data(), static_cast<std::streamsize>(term_strings_.size()));
+    pos += term_strings_.size();
+    write_padding(out, pos);
+    append_file(out, path_ + ".skips.tmp", pos);
+    if (positional_) append_file(out, path_ + ".position_blocks.tmp", pos);
+    append_file(out, path_ + ".postings.tmp", pos);
+    if (positional_) append_file(out, path_ + ".positions.tmp", pos);
+    write_padding(out, pos);
+
+    for (const auto &entry : entries) write_pod(out, entry, pos);
+    for (size_t i = 0; i < length_slots; ++i) {
+        uint32_t len = i < doc_lengths.size() ? doc_lengths[i] : 0;
+        write_pod(out, len, pos);
+    }
+    write_padding(out, pos);
+    for (size_t i = 0; i < doc_count; ++i) {
+        docs(i, meta);
+        out << meta.source << meta.url << meta.title;
+        pos += meta.source.size() + meta.url.size() + meta.title.size();
+    }
+    write_padding(out, pos);
+    remove_side_files();
+    return static_cast<bool>(out) && pos == header.file_size;
+}
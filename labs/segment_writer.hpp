@@ -0,0 +1,45 @@
+#pragma once
+
+#include "index_format.hpp"
+#include "postings.hpp"
+#include "tokenizer.hpp"
+
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Streams a binary segment to disk. Terms must be added in ascending byte order;
+// skip entries, posting bytes and positions go to side files that finish()
+// splices in, so only the term table is held in memory. The segment is
+// positional when every added list is.
+class SegmentWriter {
+public:
+    ~SegmentWriter();
+
+    bool open(const std::string &path);
+    void add_term(std::string_view term, uint64_t cf, uint32_t df, const PostingList &postings);
+    // docs must be ordered by ascending id; doc_lengths[id - docs.front().id]
+    // belongs to doc id, and ids past its end count as 0
+    bool finish(const std::vector<Document> &docs, const std::vector<uint32_t> &doc_lengths,
+                const TokenizationStats &stats);
+    // Same with doc metadata fetched by position; docs is called twice per doc
+    bool finish(size_t doc_count, const DocMetadata &docs, const std::vector<uint32_t> &doc_lengths,
+                const TokenizationStats &stats);
+
+private:
+    void remove_side_files();
+
+    std::string path_;
+    std::ofstream skips_out_;
+    std::ofstream postings_out_;
+    std::ofstream position_blocks_out_;
+    std::ofstream positions_out_;
+    std::vector<segment::TermEntry> terms_;
+    std::string term_strings_;
+    uint64_t skip_count_{0};
+    uint64_t posting_bytes_{0};
+    uint64_t position_block_count_{0};
+    uint64_t position_bytes_{0};
+    bool positional_{true};
+};
@@ -0,0 +1,471 @@
+#include "segmented_index.hpp"
+#include "segment_writer.hpp"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <queue>
+#include <unordered_map>
+
+namespace {
+size_t size_tier(size_t docs) {
+    size_t tier = 0;
+    while (docs >= SegmentedIndex::kMergeFactor) {
+        docs /= SegmentedIndex::kMergeFactor;
+        ++tier;
+    }
+    return tier;
+}
+
+std::string segment_name(uint64_t n) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "seg_%06llu", static_cast<unsigned long long>(n));
+    return buf;
+}
+
+// Writes via a temp file so readers never see a half-written file
+bool replace_file(const std::string &path, const std::string &data) {
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cerr << "Cannot write file: " << tmp << "\n";
+            return false;
+        }
+        out.write(data.data(), static_cast<std::streamsize>(data.size()));
+        if (!out) return false;
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    if (ec) {
+        std::cerr << "Cannot replace file: " << path << "\n";
+        return false;
+    }
+    return true;
+}
+}
+
+SegmentedIndex::~SegmentedIndex() {
+    wait_for_merges();
+}
+
+std::string SegmentedIndex::path_of(const std::string &name, const char *ext) const {
+    return dir_ + "/" + name + ext;
+}
+
+SegmentedIndex::SegmentPtr SegmentedIndex::load_segment(const std::string &name) const {
+    auto seg = std::make_shared<Segment>();
+    seg->name = name;
+    if (!seg->index.open(path_of(name, ".bin"))) return nullptr;
+    seg->index.set_cache_capacity(0, pair_cache_bytes_);
+    seg->deleted = DocBitmap(seg->index.first_doc_id());
+
+    std::ifstream in(path_of(name, ".del"), std::ios::binary);
+    uint64_t id;
+    while (in.read(reinterpret_cast<char *>(&id), sizeof(id))) seg->deleted.set(id);
+    return seg;
+}
+
+bool SegmentedIndex::save_tombstones(Segment &seg) const {
+    std::vector<uint64_t> ids = seg.deleted.ids();
+    std::string data(reinterpret_cast<const char *>(ids.data()), ids.size() * sizeof(uint64_t));
+    if (!replace_file(path_of(seg.name, ".del"), data)) return false;
+    seg.dirty = false;
+    return true;
+}
+
+bool SegmentedIndex::save_manifest() const {
+    std::string data = "next_doc_id " + std::to_string(next_doc_id_) + "\n";
+    data += "next_segment " + std::to_string(next_segment_) + "\n";
+    data += "positional " + std::to_string(positional_ ? 1 : 0) + "\n";
+    for (const auto &seg : segments_) data += "segment " + seg->name + "\n";
+    return replace_file(dir_ + "/MANIFEST", data);
+}
+
+bool SegmentedIndex::open(const std::string &dir) {
+    wait_for_merges();
+    std::unique_lock<std::shared_mutex> lock(mu_);
+    dir_ = dir;
+    segments_.clear();
+    invalidate_results();
+    writer_ = InvertedIndex();
+    next_doc_id_ = 1;
+    next_segment_ = 1;
+    positional_ = false;
+
+    std::error_code ec;
+    std::filesystem::create_directories(dir_, ec);
+    if (ec) {
+        std::cerr << "Cannot create index directory: " << dir_ << "\n";
+        return false;
+    }
+
+    std::ifstream in(dir_ + "/MANIFEST");
+    std::string key, value;
+    while (in >> key >> value) {
+        if (key == "next_doc_id") {
+            next_doc_id_ = std::stoull(value);
+        } else if (key == "next_segment") {
+            next_segment_ = std::stoull(value);
+        } else if (key == "positional") {
+            positional_ = value == "1";
+        } else if (key == "segment") {
+            SegmentPtr seg = load_segment(value);
+            if (!seg) return false;
+            segments_.push_back(std::move(seg));
+        }
+    }
+    writer_deleted_ = DocBitmap(next_doc_id_);
+    writer_.set_positional(positional_);
+    return true;
+}
+
+void SegmentedIndex::set_positional(bool on) {
+    std::unique_lock<std::shared_mutex> lock(mu_);
+    positional_ = on;
+    if (writer_.doc_count() == 0) writer_.set_positional(on);
+}
+
+uint64_t SegmentedIndex::add_document(const DocumentView &doc) {
+    std::unique_lock<std::shared_mutex> lock(mu_);
+    DocumentView copy = doc;
+    copy.id = next_doc_id_++;
+    writer_.add_document(copy);
+    invalidate_results();
+    return copy.id;
+}
+
+bool SegmentedIndex::delete_document(uint64_t doc_id) {
+    std::unique_lock<std::shared_mutex> lock(mu_);
+    if (doc_id >= writer_deleted_.first() && doc_id < next_doc_id_) {
+        if (writer_deleted_.test(doc_id)) return false;
+        writer_deleted_.set(doc_id);
+        invalidate_results();
+        return true;
+    }
+    for (auto &seg : segments_) {
+        if (seg->index.doc(doc_id).id == 0) continue;
+        if (seg->deleted.test(doc_id)) return false;
+        seg->deleted.set(doc_id);
+        seg->dirty = true;
+        invalidate_results();
+        return true;
+    }
+    return false;
+}
+
+bool SegmentedIndex::flush() {
+    {
+        std::unique_lock<std::shared_mutex> lock(mu_);
+        if (writer_.doc_count()) {
+            std::string name = segment_name(next_segment_++);
+            if (!writer_.save_binary(path_of(name, ".bin"))) return false;
+            SegmentPtr seg = load_segment(name);
+            if (!seg) return false;
+            seg->deleted = std::move(writer_deleted_);
+            seg->dirty = !seg->deleted.empty();
+            segments_.push_back(std::move(seg));
+            writer_ = InvertedIndex();
+            writer_.set_positional(positional_);
+            writer_deleted_ = DocBitmap(next_doc_id_);
+            invalidate_results();
+        }
+        for (auto &seg : segments_) {
+            if (seg->dirty && !save_tombstones(*seg)) return false;
+        }
+        if (!save_manifest()) return false;
+    }
+    maybe_merge();
+    return true;
+}
+
+void SegmentedIndex::wait_for_merges() {
+    std::unique_lock<std::mutex> lock(merge_mu_);
+    merge_cv_.wait(lock, [this] { return !merging_; });
+    if (merge_thread_.joinable()) merge_thread_.join();
+}
+
+void SegmentedIndex::maybe_merge() {
+    std::lock_guard<std::mutex> lock(merge_mu_);
+    if (merging_) return;
+    if (merge_thread_.joinable()) merge_thread_.join();
+    merging_ = true;
+    merge_thread_ = std::thread([this] {
+        while (true) {
+            std::vector<SegmentPtr> inputs;
+            std::string name;
+            {
+                std::unique_lock<std::shared_mutex> lock(mu_);
+                inputs = pick_merge();
+                if (inputs.empty()) break;
+                name = segment_name(next_segment_++);
+            }
+            if (!merge_segments(inputs, name)) break;
+        }
+        std::lock_guard<std::mutex> lock(merge_mu_);
+        merging_ = false;
+        merge_cv_.notify_all();
+    });
+}
+
+// Size-tiered policy: kMergeFactor adjacent segments of one tier, or a single
+// segment that is mostly tombstones. Adjacent inputs keep doc ids ascending.
+std::vector<SegmentedIndex::SegmentPtr> SegmentedIndex::pick_merge() const {
+    auto live = [](const SegmentPtr &seg) { return seg->index.doc_count() - seg->deleted.count(); };
+    for (size_t i = 0; i + kMergeFactor <= segments_.size(); ++i) {
+        size_t tier = size_tier(live(segments_[i]));
+        size_t j = i + 1;
+        while (j < i + kMergeFactor && size_tier(live(segments_[j])) == tier) ++j;
+        if (j == i + kMergeFactor) return {segments_.begin() + i, segments_.begin() + j};
+    }
+    for (const auto &seg : segments_) {
+        if (seg->deleted.count() * 2 > seg->index.doc_count()) return {seg};
+    }
+    return {};
+}
+
+bool SegmentedIndex::merge_segments(const std::vector<SegmentPtr> &inputs, const std::string &name) {
+    // Tombstones added while merging are carried over when the result is installed
+    std::vector<DocBitmap> deleted;
+    {
+        std::shared_lock<std::shared_mutex> lock(mu_);
+        for (const auto &seg : inputs) deleted.push_back(seg->deleted);
+    }
+
+    std::vector<Document> docs;
+    std::vector<uint32_t> doc_lengths;
+    TokenizationStats stats;
+    for (size_t s = 0; s < inputs.size(); ++s) {
+        const MappedIndex &index = inputs[s]->index;
+        for (size_t i = 0; i < index.doc_count(); ++i) {
+            DocRef ref = index.doc_at(i);
+            if (deleted[s].test(ref.id)) continue;
+            Document doc;
+            doc.id = ref.id;
+            doc.source.assign(ref.source.data(), ref.source.size());
+            doc.url.assign(ref.url.data(), ref.url.size());
+            doc.title.assign(ref.title.data(), ref.title.size());
+            docs.push_back(std::move(doc));
+            // Dropped docs leave zero slots, keeping lengths aligned with the kept ids
+            doc_lengths.resize(ref.id - docs.front().id, 0);
+            doc_lengths.push_back(index.doc_lengths()[ref.id]);
+        }
+        // Token counts of dropped docs are not tracked per doc, so they stay in
+        TokenizationStats st = index.stats();
+        stats.tokens += st.tokens;
+        stats.token_chars += st.token_chars;
+        stats.bytes_in += st.bytes_in;
+    }
+    stats.docs = docs.size();
+
+    std::string path = path_of(name, ".bin");
+    SegmentPtr merged;
+    if (!docs.empty()) {
+        SegmentWriter writer;
+        if (!writer.open(path)) return false;
+
+        // k-way merge of the sorted term tables; ties pop in input order, so
+        // postings of one term arrive with ascending doc ids
+        using Cursor = std::pair<size_t, size_t>;  // input, term position
+        auto later = [&inputs](const Cursor &a, const Cursor &b) {
+            std::string_view ta = inputs[a.first]->index.term_at(a.second);
+            std::string_view tb = inputs[b.first]->index.term_at(b.second);
+            if (ta != tb) return ta > tb;
+            return a.first > b.first;
+        };
+        std::priority_queue<Cursor, std::vector<Cursor>, decltype(later)> heap(later);
+        for (size_t s = 0; s < inputs.size(); ++s) {
+            if (inputs[s]->index.vocab_size()) heap.push({s, 0});
+        }
+
+        PostingList postings;
+        std::vector<uint32_t> positions;
+        while (!heap.empty()) {
+            std::string term(inputs[heap.top().first]->index.term_at(heap.top().second));
+            postings = PostingList();
+            uint64_t cf = 0;
+            while (!heap.empty() && inputs[heap.top().first]->index.term_at(heap.top().second) == term) {
+                Cursor c = heap.top();
+                heap.pop();
+                const MappedIndex &index = inputs[c.first]->index;
+                for (PostingIterator it(index.postings_at(c.second)); it.valid(); it.next()) {
+                    if (deleted[c.first].test(it.doc())) continue;
+                    if (it.has_positions()) it.positions(positions);
+                    postings.push_back(it.doc(), it.tf(), it.has_positions() ? positions.data() : nullptr);
+                    cf += it.tf();
+                }
+                if (c.second + 1 < index.vocab_size()) heap.push({c.first, c.second + 1});
+            }
+            if (!postings.size()) continue;
+            writer.add_term(term, cf, static_cast<uint32_t>(postings.size()), postings);
+        }
+        if (!writer.finish(docs, doc_lengths, stats)) return false;
+        merged = load_segment(name);
+        if (!merged) return false;
+    }
+
+    {
+        std::unique_lock<std::shared_mutex> lock(mu_);
+        size_t pos = 0;
+        while (pos < segments_.size() && segments_[pos] != inputs.front()) ++pos;
+        if (merged) {
+            for (const auto &seg : inputs) {
+                for (uint64_t id : seg->deleted.ids()) {
+                    if (merged->index.doc(id).id != 0) merged->deleted.set(id);
+                }
+            }
+            merged->dirty = !merged->deleted.empty();
+            if (merged->dirty && !save_tombstones(*merged)) return false;
+        }
+        segments_.erase(segments_.begin() + pos, segments_.begin() + pos + inputs.size());
+        if (merged) segments_.insert(segments_.begin() + pos, merged);
+        // Dropped tombstones change the collection stats, and with them the scores
+        invalidate_results();
+        if (!save_manifest()) return false;
+    }
+
+    // Searches still holding an input keep their mapping; unlinking is safe
+    std::error_code ec;
+    for (const auto &seg : inputs) {
+        std::filesystem::remove(path_of(seg->name, ".bin"), ec);
+        std::filesystem::remove(path_of(seg->name, ".del"), ec);
+    }
+    return true;
+}
+
+void SegmentedIndex::set_ranking(const RankingParams &params) {
+    std::unique_lock<std::shared_mutex> lock(mu_);
+    ranking_ = params;
+    invalidate_results();
+}
+
+void SegmentedIndex::set_cache_capacity(size_t result_bytes, size_t pair_bytes) {
+    std::unique_lock<std::shared_mutex> lock(mu_);
+    if (result_bytes) results_ = std::make_unique<ResultCache>(result_bytes);
+    else results_.reset();
+    pair_cache_bytes_ = pair_bytes;
+    for (auto &seg : segments_) seg->index.set_cache_capacity(0, pair_bytes);
+}
+
+void SegmentedIndex::invalidate_results() {
+    if (results_) results_->clear();
+}
+
+CacheCounters SegmentedIndex::result_cache_counters() const {
+    std::shared_lock<std::shared_mutex> lock(mu_);
+    return results_ ? results_->counters() : CacheCounters{};
+}
+
+CacheCounters SegmentedIndex::pair_cache_counters() const {
+    std::shared_lock<std::shared_mutex> lock(mu_);
+    CacheCounters total;
+    for (const auto &seg : segments_) {
+        if (!seg->index.cache()) continue;
+        CacheCounters c = seg->index.cache()->pairs.counters();
+        total.hits += c.hits;
+        total.misses += c.misses;
+        total.evictions += c.evictions;
+        total.entries += c.entries;
+        total.bytes += c.bytes;
+    }
+    return total;
+}
+
+std::vector<SearchHit> SegmentedIndex::search(const std::string &query, size_t k) const {
+    // Held across lookup and insert, so writers (who clear the cache under the
+    // exclusive lock) never interleave with a stale result being stored
+    std::shared_lock<std::shared_mutex> lock(mu_);
+    if (results_) {
+        return cached_search(query, k, *results_, [&](const QueryNode &root) { return search_locked(root, k); });
+    }
+    return search_locked(simplify_query(parse_query(query)), k);
+}
+
+std::vector<SearchHit> SegmentedIndex::search(const QueryNode &root, size_t k) const {
+    std::shared_lock<std::shared_mutex> lock(mu_);
+    return search_locked(root, k);
+}
+
+std::vector<SearchHit> SegmentedIndex::search_locked(const QueryNode &root, size_t k) const {
+    CollectionStats global = writer_.collection_stats();
+    for (const auto &seg : segments_) {
+        CollectionStats st = seg->index.collection_stats();
+        global.doc_count += st.doc_count;
+        global.total_length += st.total_length;
+    }
+    // A pattern's df is the size of its expansion; remembered because every
+    // segment's scorer asks for it again
+    std::unordered_map<std::string, uint64_t> pattern_df;
+    DfLookup global_df = [this, &pattern_df](const std::string &term) {
+        if (is_term_pattern(term)) {
+            auto it = pattern_df.find(term);
+            if (it != pattern_df.end()) return it->second;
+            uint64_t df = writer_.pattern_postings(term)->size();
+            for (const auto &seg : segments_) df += seg->index.pattern_postings(term)->size();
+            pattern_df.emplace(term, df);
+            return df;
+        }
+        const TokenInfo *info = writer_.find(term);
+        uint64_t df = info ? info->df : 0;
+        for (const auto &seg : segments_) df += seg->index.postings(term).count;
+        return df;
+    };
+
+    std::vector<std::vector<SearchHit>> parts;
+    parts.reserve(segments_.size() + 1);
+    for (const auto &seg : segments_) {
+        Scorer scorer(ranking_, global, seg->index.doc_lengths(), global_df);
+        parts.push_back(seg->index.search(root, k, &seg->deleted, &scorer));
+    }
+    Scorer scorer(ranking_, global, writer_.doc_lengths(), global_df);
+    parts.push_back(writer_.search(root, k, &writer_deleted_, &scorer));
+    return merge_hits(std::move(parts), k);
+}
+
+DocRef SegmentedIndex::doc(uint64_t doc_id) const {
+    std::shared_lock<std::shared_mutex> lock(mu_);
+    if (doc_id >= writer_deleted_.first() && doc_id < next_doc_id_) {
+        if (writer_deleted_.test(doc_id)) return {};
+        const Document &doc = writer_.docs()[doc_id - writer_deleted_.first()];
+        return {doc.id, doc.source, doc.url, doc.title};
+    }
+    for (const auto &seg : segments_) {
+        if (seg->deleted.test(doc_id)) return {};
+        DocRef ref = seg->index.doc(doc_id);
+        if (ref.id != 0) return ref;
+    }
+    return {};
+}
+
+size_t SegmentedIndex::segment_count() const {
+    std::shared_lock<std::shared_mutex> lock(mu_);
+    return segments_.size();
+}
+
+size_t SegmentedIndex::doc_count() const {
+    std::shared_lock<std::shared_mutex> lock(mu_);
+    size_t n = writer_.doc_count() - writer_deleted_.count();
+    for (const auto &seg : segments_) n += seg->index.doc_count() - seg->deleted.count();
+    return n;
+}
+
+size_t SegmentedIndex::vocab_size() const {
+    std::shared_lock<std::shared_mutex> lock(mu_);
+    size_t n = writer_.vocab_size();
+    for (const auto &seg : segments_) n += seg->index.vocab_size();
+    return n;
+}
+
+TokenizationStats SegmentedIndex::stats() const {
+    std::shared_lock<std::shared_mutex> lock(mu_);
+    TokenizationStats total = writer_.stats();
+    for (const auto &seg : segments_) {
+        TokenizationStats st = seg->index.stats();
+        total.docs += st.docs;
+        total.tokens += st.tokens;
+        total.token_chars += st.token_chars;
+        total.bytes_in += st.bytes_in;
+    }
+    return total;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "doc_bitmap.hpp"
+#include "index.hpp"
+#include "mapped_index.hpp"
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Index that accepts new and deleted documents without a full rebuild.
+// New docs go to an in-memory write segment; flush() turns it into an immutable
+// mmapped segment in dir. Deletes are tombstones kept per segment and dropped
+// for good when a background size-tiered merge rewrites the segment.
+// Search fans out over all segments and merges the per-segment top k.
+//
+// dir layout: MANIFEST (next ids and live segments), seg_N.bin, seg_N.del (u64 ids)
+class SegmentedIndex {
+public:
+    // A merge starts once this many adjacent segments share a size tier
+    static constexpr size_t kMergeFactor = 4;
+
+    SegmentedIndex() = default;
+    ~SegmentedIndex();
+    SegmentedIndex(const SegmentedIndex &) = delete;
+    SegmentedIndex &operator=(const SegmentedIndex &) = delete;
+
+    // Loads the manifest from dir, or starts an empty index there
+    bool open(const std::string &dir);
+
+    // New segments keep token positions; recorded in the manifest
+    void set_positional(bool on);
+
+    // Assigns and returns the next doc id; doc.id is ignored
+    uint64_t add_document(const DocumentView &doc);
+    // Returns false when doc_id is unknown or already deleted
+    bool delete_document(uint64_t doc_id);
+    // Persists the write segment and any new tombstones, then schedules merges
+    bool flush();
+    void wait_for_merges();
+
+    // Scores use collection-wide doc count, average length and df, so hits of
+    // different segments are comparable. Tombstoned docs still count until merged.
+    std::vector<SearchHit> search(const std::string &query, size_t k = 0) const;
+    std::vector<SearchHit> search(const QueryNode &root, size_t k = 0) const;
+    void set_ranking(const RankingParams &params);
+    // Results are cached index-wide and dropped on every add, delete, flush or
+    // merge; each segment keeps its own pair cache of pair_bytes. Zero disables.
+    void set_cache_capacity(size_t result_bytes, size_t pair_bytes);
+    CacheCounters result_cache_counters() const;
+    CacheCounters pair_cache_counters() const;  // summed over live segments
+    // Returns id 0 for unknown or deleted docs. The views stay valid until the
+    // next flush() or merge
+    DocRef doc(uint64_t doc_id) const;
+
+    size_t segment_count() const;
+    size_t doc_count() const;  // live docs
+    size_t vocab_size() const; // upper bound: terms are counted per segment
+    TokenizationStats stats() const;
+
+private:
+    struct Segment {
+        std::string name;
+        MappedIndex index;
+        DocBitmap deleted;
+        bool dirty{false};  // tombstones not yet written
+    };
+    using SegmentPtr = std::shared_ptr<Segment>;
+
+    std::string dir_;
+    mutable std::shared_mutex mu_;
+    std::vector<SegmentPtr> segments_;  // ascending doc ids
+    InvertedIndex writer_;
+    DocBitmap writer_deleted_;
+    uint64_t next_doc_id_{1};
+    uint64_t next_segment_{1};
+    RankingParams ranking_;
+    bool positional_{false};
+    std::unique_ptr<ResultCache> results_;
+    size_t pair_cache_bytes_{0};
+
+    std::mutex merge_mu_;
+    std::condition_variable merge_cv_;
+    std::thread merge_thread_;
+    bool merging_{false};
+
+    std::string path_of(const std::string &name, const char *ext) const;
+    SegmentPtr load_segment(const std::string &name) const;
+    bool save_tombstones(Segment &seg) const;
+    bool save_manifest() const;
+    void invalidate_results();
+    // Callers hold mu_ at least shared
+    std::vector<SearchHit> search_locked(const QueryNode &root, size_t k) const;
+    void maybe_merge();
+    bool merge_segments(const std::vector<SegmentPtr> &inputs, const std::string &name);
+    // Callers hold mu_
+    std::vector<SegmentPtr> pick_merge() const;
+};
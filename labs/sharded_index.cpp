@@ -0,0 +1,259 @@
+#include "sharded_index.hpp"
+#include "index.hpp"
+#include "loader.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <unordered_map>
+
+namespace {
+std::string shard_name(size_t n) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "shard_%04zu", n);
+    return buf;
+}
+
+// Every normalized term and pattern whose df a scorer may ask for
+void collect_terms(const QueryNode &node, std::vector<std::string> &out) {
+    switch (node.kind) {
+        case QueryNode::Term:
+        case QueryNode::Pattern:
+            out.push_back(node.term);
+            break;
+        case QueryNode::Phrase:
+        case QueryNode::Near:
+            out.insert(out.end(), node.terms.begin(), node.terms.end());
+            break;
+        default:
+            for (const auto &child : node.children) collect_terms(child, out);
+    }
+}
+
+uint64_t total_df(const std::vector<std::unique_ptr<MappedIndex>> &shards, const std::string &term) {
+    uint64_t df = 0;
+    bool pattern = is_term_pattern(term);
+    for (const auto &shard : shards) df += pattern ? shard->pattern_postings(term)->size() : shard->postings(term).count;
+    return df;
+}
+}
+
+bool ShardedIndex::open(const std::string &dir, size_t threads) {
+    shards_.clear();
+    global_ = {};
+    if (results_) results_->clear();
+
+    std::ifstream in(dir + "/SHARDS");
+    if (!in) {
+        std::cerr << "Cannot open shard manifest: " << dir << "/SHARDS\n";
+        return false;
+    }
+    std::string key, value;
+    while (in >> key >> value) {
+        if (key != "shard") continue;
+        auto shard = std::make_unique<MappedIndex>();
+        if (!shard->open(dir + "/" + value + ".bin")) return false;
+        CollectionStats st = shard->collection_stats();
+        global_.doc_count += st.doc_count;
+        global_.total_length += st.total_length;
+        shards_.push_back(std::move(shard));
+    }
+    if (shards_.empty()) {
+        std::cerr << "No shards listed in: " << dir << "/SHARDS\n";
+        return false;
+    }
+
+    // The caller's thread searches one shard itself
+    size_t workers = std::min(threads, shards_.size());
+    if (workers > 1) pool_ = std::make_unique<WorkerPool>(workers - 1);
+    else pool_.reset();
+    return true;
+}
+
+void ShardedIndex::set_ranking(const RankingParams &params) {
+    ranking_ = params;
+    if (results_) results_->clear();
+}
+
+void ShardedIndex::set_cache_capacity(size_t result_bytes, size_t pair_bytes) {
+    if (result_bytes) results_ = std::make_unique<ResultCache>(result_bytes);
+    else results_.reset();
+    for (auto &shard : shards_) shard->set_cache_capacity(0, pair_bytes);
+}
+
+CacheCounters ShardedIndex::result_cache_counters() const {
+    return results_ ? results_->counters() : CacheCounters{};
+}
+
+CacheCounters ShardedIndex::pair_cache_counters() const {
+    CacheCounters total;
+    for (const auto &shard : shards_) {
+        if (!shard->cache()) continue;
+        CacheCounters c = shard->cache()->pairs.counters();
+        total.hits += c.hits;
+        total.misses += c.misses;
+        total.evictions += c.evictions;
+        total.entries += c.entries;
+        total.bytes += c.bytes;
+    }
+    return total;
+}
+
+std::vector<SearchHit> ShardedIndex::search(const std::string &query, size_t k) const {
+    if (results_) {
+        return cached_search(query, k, *results_, [&](const QueryNode &root) { return scatter_gather(root, k); });
+    }
+    return scatter_gather(simplify_query(parse_query(query)), k);
+}
+
+std::vector<SearchHit> ShardedIndex::search(const QueryNode &root, size_t k) const {
+    return scatter_gather(root, k);
+}
+
+std::vector<SearchHit> ShardedIndex::scatter_gather(const QueryNode &root, size_t k) const {
+    // Global df of the query's terms is summed before the fan-out, so the
+    // shards' scorers only read it
+    std::vector<std::string> terms;
+    collect_terms(root, terms);
+    std::unordered_map<std::string, uint64_t> df;
+    for (const auto &term : terms) {
+        if (!df.count(term)) df.emplace(term, total_df(shards_, term));
+    }
+    DfLookup global_df = [this, &df](const std::string &term) {
+        auto it = df.find(term);
+        return it != df.end() ? it->second : total_df(shards_, term);
+    };
+
+    std::vector<std::vector<SearchHit>> parts(shards_.size());
+    auto run = [&](size_t s) {
+        Scorer scorer(ranking_, global_, shards_[s]->doc_lengths(), global_df);
+        parts[s] = shards_[s]->search(root, k, nullptr, &scorer);
+    };
+    if (!pool_) {
+        for (size_t s = 0; s < shards_.size(); ++s) run(s);
+        return merge_hits(std::move(parts), k);
+    }
+
+    std::vector<std::future<void>> pending;
+    pending.reserve(shards_.size() - 1);
+    for (size_t s = 1; s < shards_.size(); ++s) {
+        auto task = std::make_shared<std::packaged_task<void()>>([&run, s]() { run(s); });
+        pending.push_back(task->get_future());
+        pool_->submit([task]() { (*task)(); });
+    }
+    // Every task refers to this frame, so all of them finish before an error propagates
+    std::exception_ptr error;
+    try {
+        run(0);
+    } catch (...) {
+        error = std::current_exception();
+    }
+    for (auto &f : pending) f.wait();
+    if (error) std::rethrow_exception(error);
+    for (auto &f : pending) f.get();
+    return merge_hits(std::move(parts), k);
+}
+
+DocRef ShardedIndex::doc(uint64_t doc_id) const {
+    auto it = std::lower_bound(shards_.begin(), shards_.end(), doc_id,
+                               [](const std::unique_ptr<MappedIndex> &s, uint64_t id) { return s->last_doc_id() < id; });
+    return it != shards_.end() ? (*it)->doc(doc_id) : DocRef{};
+}
+
+size_t ShardedIndex::doc_count() const {
+    return global_.doc_count;
+}
+
+size_t ShardedIndex::vocab_size() const {
+    size_t n = 0;
+    for (const auto &shard : shards_) n += shard->vocab_size();
+    return n;
+}
+
+TokenizationStats ShardedIndex::stats() const {
+    TokenizationStats total;
+    for (const auto &shard : shards_) {
+        TokenizationStats st = shard->stats();
+        total.docs += st.docs;
+        total.tokens += st.tokens;
+        total.token_chars += st.token_chars;
+        total.bytes_in += st.bytes_in;
+    }
+    return total;
+}
+
+bool build_shards(const std::string &ndjson_path, const std::string &dir, size_t shards, bool positional) {
+    // Docs are numbered in file order; lines bound their count, which is
+    // enough to cut the id space into contiguous ranges before parsing
+    size_t lines = 0;
+    {
+        MappedFile file;
+        if (!file.open(ndjson_path)) {
+            std::cerr << "Cannot open input NDJSON: " << ndjson_path << "\n";
+            return false;
+        }
+        std::string_view data = file.view();
+        lines = static_cast<size_t>(std::count(data.begin(), data.end(), '\n'));
+        if (!data.empty() && data.back() != '\n') ++lines;
+    }
+    size_t per_shard = std::max<size_t>(1, (lines + shards - 1) / std::max<size_t>(shards, 1));
+
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    if (ec) {
+        std::cerr << "Cannot create shard directory: " << dir << "\n";
+        return false;
+    }
+    std::string manifest = dir + "/SHARDS";
+    std::filesystem::remove(manifest, ec);
+
+    InvertedIndex current;
+    current.set_positional(positional);
+    size_t shard = 0;
+    std::vector<std::string> names;
+    auto save = [&]() {
+        if (current.doc_count() == 0) return true;
+        std::string name = shard_name(shard);
+        if (!current.save_binary(dir + "/" + name + ".bin")) return false;
+        std::cout << "[INFO] Wrote " << name << " (" << current.doc_count() << " docs)" << std::endl;
+        names.push_back(name);
+        current = InvertedIndex();
+        current.set_positional(positional);
+        return true;
+    };
+    bool ok = true;
+    process_ndjson_views(ndjson_path, [&](const DocumentView &doc) {
+        if (!ok) return;
+        size_t s = static_cast<size_t>((doc.id - 1) / per_shard);
+        if (s != shard) {
+            ok = save();
+            shard = s;
+        }
+        current.add_document(doc);
+    }, 2000);
+    if (!ok || !save()) return false;
+    if (names.empty()) {
+        std::cerr << "No documents loaded. Check input." << std::endl;
+        return false;
+    }
+
+    // Written last and via a temp file, so a failed build never leaves a manifest
+    {
+        std::ofstream out(manifest + ".tmp", std::ios::trunc);
+        for (const auto &name : names) out << "shard " << name << "\n";
+        if (!out) {
+            std::cerr << "Cannot write file: " << manifest << ".tmp\n";
+            return false;
+        }
+    }
+    std::filesystem::rename(manifest + ".tmp", manifest, ec);
+    if (ec) {
+        std::cerr << "Cannot replace file: " << manifest << "\n";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "mapped_index.hpp"
+#include "worker_pool.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// Read-only index split into shards over contiguous doc id ranges, each one a
+// segment written by InvertedIndex::save_binary. A query is scattered to all
+// shards at once, the caller's thread taking one of them, and the per-shard
+// top k are merged. Every shard scores with collection-wide doc count, average
+// length and df, so the result equals a search over one unsharded index.
+//
+// dir layout: SHARDS (one "shard <name>" line per shard, ascending ids), <name>.bin
+class ShardedIndex {
+public:
+    ShardedIndex() = default;
+    ShardedIndex(const ShardedIndex &) = delete;
+    ShardedIndex &operator=(const ShardedIndex &) = delete;
+
+    // Up to threads shards are searched in parallel per query
+    bool open(const std::string &dir, size_t threads = 1);
+
+    std::vector<SearchHit> search(const std::string &query, size_t k = 0) const;
+    std::vector<SearchHit> search(const QueryNode &root, size_t k = 0) const;
+    // Not thread-safe against running searches
+    void set_ranking(const RankingParams &params);
+    // Results are cached coordinator-wide, pairs per shard. Zero disables.
+    void set_cache_capacity(size_t result_bytes, size_t pair_bytes);
+    CacheCounters result_cache_counters() const;
+    CacheCounters pair_cache_counters() const;  // summed over shards
+    // Returns id 0 for unknown docs
+    DocRef doc(uint64_t doc_id) const;
+
+    size_t shard_count() const { return shards_.size(); }
+    size_t doc_count() const;
+    size_t vocab_size() const;  // upper bound: terms are counted per shard
+    TokenizationStats stats() const;
+
+private:
+    std::vector<std::unique_ptr<MappedIndex>> shards_;  // ascending doc ids
+    CollectionStats global_;
+    RankingParams ranking_;
+    std::unique_ptr<ResultCache> results_;
+    std::unique_ptr<WorkerPool> pool_;
+
+    std::vector<SearchHit> scatter_gather(const QueryNode &root, size_t k) const;
+};
+
+// Splits the docs of an NDJSON file into the given number of shards of about
+// equal size and writes them to dir, keeping one shard in memory at a time.
+// Doc ids match those of an unsharded build of the same file.
+bool build_shards(const std::string &ndjson_path, const std::string &dir, size_t shards, bool positional);
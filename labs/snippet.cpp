@@ -0,0 +1,137 @@
+#include "snippet.hpp"
+#include "stemmer.hpp"
+#include "term_dict.hpp"
+#include "tokenizer.hpp"
+
+#include <algorithm>
+
+namespace {
+struct Word {
+    size_t begin;
+    size_t end;
+    int term;  // index into the highlight terms, -1 for none
+};
+
+void collect(const QueryNode &node, std::vector<std::string> &terms) {
+    switch (node.kind) {
+        case QueryNode::Term:
+        case QueryNode::Pattern:
+            terms.push_back(node.term);
+            break;
+        case QueryNode::Phrase:
+        case QueryNode::Near:
+            terms.insert(terms.end(), node.terms.begin(), node.terms.end());
+            break;
+        case QueryNode::And:
+        case QueryNode::Or:
+            for (const auto &child : node.children) collect(child, terms);
+            break;
+        case QueryNode::Not:
+            break;
+    }
+}
+
+std::vector<Word> split_words(std::string_view body, const std::vector<std::string> &terms) {
+    std::vector<Word> words;
+    size_t i = 0;
+    bool delim = false;
+    while (i < body.size()) {
+        // Cut where tokenize_document does, so "—", "«" or a NBSP never join words
+        while (i < body.size()) {
+            size_t len = scan_code_point(body, i, delim);
+            if (!delim) break;
+            i += len;
+        }
+        size_t begin = i;
+        while (i < body.size()) {
+            size_t len = scan_code_point(body, i, delim);
+            if (delim) break;
+            i += len;
+        }
+        if (i == begin) break;
+        int term = -1;
+        if (!terms.empty()) {
+            std::string folded = fold_token(body.substr(begin, i - begin));
+            std::string_view stem = stem_view(folded);
+            auto it = std::find_if(terms.begin(), terms.end(), [stem](const std::string &t) {
+                return t == stem || (is_term_pattern(t) && match_term_pattern(t, stem));
+            });
+            if (it != terms.end()) term = static_cast<int>(it - terms.begin());
+        }
+        words.push_back({begin, i, term});
+    }
+    return words;
+}
+
+void append_text(std::string &out, std::string_view text, bool escape) {
+    if (!escape) {
+        out.append(text.data(), text.size());
+        return;
+    }
+    for (char c : text) {
+        switch (c) {
+            case '&': out += "&amp;"; break;
+            case '<': out += "&lt;"; break;
+            case '>': out += "&gt;"; break;
+            default: out += c;
+        }
+    }
+}
+}
+
+std::vector<std::string> highlight_terms(const QueryNode &root) {
+    std::vector<std::string> terms;
+    collect(root, terms);
+    std::sort(terms.begin(), terms.end());
+    terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+    terms.erase(std::remove(terms.begin(), terms.end(), std::string()), terms.end());
+    return terms;
+}
+
+std::string make_snippet(std::string_view body, const std::vector<std::string> &terms,
+                         const SnippetOptions &options) {
+    std::vector<Word> words = split_words(body, terms);
+    if (words.empty()) return {};
+    size_t window = std::max<size_t>(1, std::min(options.words, words.size()));
+
+    // Slide the window one word at a time, keeping per-term counts inside it
+    std::vector<uint32_t> inside(terms.size(), 0);
+    size_t distinct = 0, hits = 0;
+    auto enter = [&](const Word &w, bool in) {
+        if (w.term < 0) return;
+        uint32_t &count = inside[static_cast<size_t>(w.term)];
+        if (in) {
+            if (count++ == 0) ++distinct;
+            ++hits;
+        } else {
+            if (--count == 0) --distinct;
+            --hits;
+        }
+    };
+    for (size_t i = 0; i < window; ++i) enter(words[i], true);
+    size_t best = 0, best_distinct = distinct, best_hits = hits;
+    for (size_t start = 1; start + window <= words.size(); ++start) {
+        enter(words[start - 1], false);
+        enter(words[start + window - 1], true);
+        if (distinct > best_distinct || (distinct == best_distinct && hits > best_hits)) {
+            best = start;
+            best_distinct = distinct;
+            best_hits = hits;
+        }
+    }
+
+    std::string out;
+    if (best > 0) out += "... ";
+    size_t last = best + window;
+    size_t pos = words[best].begin;
+    for (size_t i = best; i < last; ++i) {
+        const Word &w = words[i];
+        append_text(out, body.substr(pos, w.begin - pos), options.escape_html);
+        if (w.term >= 0) out += options.open;
+        append_text(out, body.substr(w.begin, w.end - w.begin), options.escape_html);
+        if (w.term >= 0) out += options.close;
+        pos = w.end;
+    }
+    if (last < words.size()) out += " ...";
+    return out;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "query_parser.hpp"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct SnippetOptions {
+    size_t words{30};           // window length
+    std::string open{"<b>"};    // around every matching word
+    std::string close{"</b>"};
+    bool escape_html{true};     // escape &, < and > of the body text
+};
+
+// Normalized terms of the positive part of a query (nothing under NOT)
+std::vector<std::string> highlight_terms(const QueryNode &root);
+
+// The window of body with the most distinct query terms (then the most matches),
+// with "..." where body was cut. Words are compared after the same folding and
+// stemming as at index time; pattern terms match every stem they cover.
+// Without matches the window is the start of body.
+std::string make_snippet(std::string_view body, const std::vector<std::string> &terms,
+                         const SnippetOptions &options = {});
@@ -0,0 +1,150 @@
+#include "spimi.hpp"
+#include "buffered_writer.hpp"
+#include "segment_writer.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <queue>
+
+namespace {
+template <typename T>
+void put(std::ofstream &out, const T &value) {
+    out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T>
+bool get(std::ifstream &in, T &value) {
+    return static_cast<bool>(in.read(reinterpret_cast<char *>(&value), sizeof(T)));
+}
+
+class RunReader {
+public:
+    explicit RunReader(const std::string &path) : in_(path, std::ios::binary) {
+        if (!in_) std::cerr << "Cannot open run file: " << path << "\n";
+        next();
+    }
+
+    bool valid() const { return valid_; }
+    const std::string &term() const { return term_; }
+    uint64_t cf() const { return cf_; }
+    uint32_t df() const { return df_; }
+    uint64_t count() const { return count_; }
+    const std::vector<uint8_t> &bytes() const { return bytes_; }
+    const std::vector<uint8_t> &positions() const { return positions_; }
+
+    void next() {
+        uint32_t len = 0;
+        uint64_t nbytes = 0;
+        valid_ = get(in_, len);
+        if (!valid_) return;
+        term_.resize(len);
+        in_.read(&term_[0], len);
+        valid_ = get(in_, cf_) && get(in_, df_) && get(in_, count_) && get(in_, nbytes);
+        if (!valid_) return;
+        bytes_.resize(nbytes);
+        valid_ = static_cast<bool>(in_.read(reinterpret_cast<char *>(bytes_.data()), static_cast<std::streamsize>(nbytes)));
+        valid_ = valid_ && get(in_, nbytes);
+        if (!valid_) return;
+        positions_.resize(nbytes);
+        valid_ = static_cast<bool>(in_.read(reinterpret_cast<char *>(positions_.data()), static_cast<std::streamsize>(nbytes)));
+    }
+
+private:
+    std::ifstream in_;
+    bool valid_{false};
+    std::string term_;
+    uint64_t cf_{0};
+    uint32_t df_{0};
+    uint64_t count_{0};
+    std::vector<uint8_t> bytes_;
+    std::vector<uint8_t> positions_;
+};
+}
+
+bool write_run(const std::string &path, const InvertedIndex &index) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        std::cerr << "Cannot write run file: " << path << "\n";
+        return false;
+    }
+    for (uint32_t id : index.sorted_term_ids()) {
+        std::string_view term = index.dictionary().term(id);
+        const TokenInfo &info = index.terms()[id];
+        const auto &bytes = info.postings.bytes();
+        put(out, static_cast<uint32_t>(term.size()));
+        out.write(term.data(), static_cast<std::streamsize>(term.size()));
+        put(out, info.cf);
+        put(out, info.df);
+        put(out, static_cast<uint64_t>(info.postings.size()));
+        put(out, static_cast<uint64_t>(bytes.size()));
+        out.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+        const auto &positions = info.postings.positions();
+        put(out, static_cast<uint64_t>(positions.size()));
+        out.write(reinterpret_cast<const char *>(positions.data()), static_cast<std::streamsize>(positions.size()));
+    }
+    return static_cast<bool>(out);
+}
+
+bool merge_runs(const std::vector<std::string> &runs, size_t doc_count, const DocMetadata &docs,
+                const std::vector<uint32_t> &doc_lengths, const TokenizationStats &stats, const std::string &bin_path, const std::string &tsv_path,
+                std::vector<TermStats> &vocab) {
+    std::vector<RunReader> readers;
+    readers.reserve(runs.size());
+    for (const auto &path : runs) readers.emplace_back(path);
+
+    // Min-heap by (term, run index); equal terms pop in run order, i.e. ascending doc ids
+    auto later = [&](size_t a, size_t b) {
+        int cmp = readers[a].term().compare(readers[b].term());
+        return cmp != 0 ? cmp > 0 : a > b;
+    };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(later)> heap(later);
+    for (size_t i = 0; i < readers.size(); ++i) {
+        if (readers[i].valid()) heap.push(i);
+    }
+
+    SegmentWriter writer;
+    if (!writer.open(bin_path)) return false;
+    BufferedWriter tsv;
+    if (!tsv.open(tsv_path)) return false;
+    tsv.put("token\tdoc_id\ttf\n");
+
+    std::vector<uint32_t> positions;
+    while (!heap.empty()) {
+        std::string term = readers[heap.top()].term();
+        uint64_t cf = 0;
+        uint32_t df = 0;
+        PostingList postings;
+        while (!heap.empty() && readers[heap.top()].term() == term) {
+            size_t i = heap.top();
+            heap.pop();
+            RunReader &r = readers[i];
+            cf += r.cf();
+            df += r.df();
+            const uint8_t *p = r.bytes().data();
+            const uint8_t *pos = r.positions().empty() ? nullptr : r.positions().data();
+            uint64_t doc = 0;
+            for (uint64_t n = 0; n < r.count(); ++n) {
+                doc += read_varint(p);
+                uint32_t tf = static_cast<uint32_t>(read_varint(p));
+                if (pos) {
+                    positions.clear();
+                    uint32_t at = 0;
+                    for (uint32_t j = 0; j < tf; ++j) positions.push_back(at += static_cast<uint32_t>(read_varint(pos)));
+                }
+                postings.push_back(doc, tf, pos ? positions.data() : nullptr);
+                tsv.put(term);
+                tsv.put('\t');
+                tsv.put_uint(doc);
+                tsv.put('\t');
+                tsv.put_uint(tf);
+                tsv.put('\n');
+            }
+            r.next();
+            if (r.valid()) heap.push(i);
+        }
+        writer.add_term(term, cf, df, postings);
+        vocab.push_back({term, cf, df});
+    }
+    return tsv.close() && writer.finish(doc_count, docs, doc_lengths, stats);
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "index.hpp"
+
+#include <string>
+#include <vector>
+
+// Run file: records sorted by term, each
+//   [u32 term_len][term][u64 cf][u32 df][u64 count][u64 byte_len][posting bytes]
+//   [u64 position_len][position bytes]
+// where posting bytes are the PostingList varint stream (first gap is the absolute doc id)
+// and position bytes its positions side stream, empty for a non-positional index.
+bool write_run(const std::string &path, const InvertedIndex &index);
+
+// Streams a k-way merge of run files (given in creation order, i.e. ascending doc ranges)
+// into a binary segment and inverted_index.tsv. Per-term stats are returned in vocab.
+bool merge_runs(const std::vector<std::string> &runs, size_t doc_count, const DocMetadata &docs,
+                const std::vector<uint32_t> &doc_lengths, const TokenizationStats &stats, const std::string &bin_path, const std::string &tsv_path,
+                std::vector<TermStats> &vocab);
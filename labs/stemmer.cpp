@@ -1,30 +1,93 @@
 #include "stemmer.hpp"
 
-#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <map>
 
-std::string stem_word(const std::string &word) {
-    static const char *endings[] = {
-        "овать", "ывать", "ировать", "ующий", "ation",
-        "иями", "ями", "иями", "ения", "ении",
-        "ость", "ости", "ост", "остью",
-        "ский", "ская", "ское", "ские",
-        "ого", "ему", "ыми", "его", "ому",
-        "ать", "ять", "ить", "еть",
-        "ом", "ам", "ах", "ях",
-        "ой", "ей", "ый", "ий",
-        "ов", "ев", "ам", "ям",
-        "ы", "и", "е", "я", "ю", "ь",
-        nullptr
-    };
-
-    if (word.size() < 4) return word;
-
-    for (int i = 0; endings[i] != nullptr; ++i) {
-        const char *suf = endings[i];
-        size_t len = std::strlen(suf);
-        if (word.size() > len + 1 && word.compare(word.size() - len, len, suf) == 0) {
-            return word.substr(0, word.size() - len);
+namespace {
+const char *kEndings[] = {
+    "овать", "ывать", "ировать", "ующий", "ation",
+    "иями", "ями", "ения", "ении",
+    "ость", "ости", "ост", "остью",
+    "ский", "ская", "ское", "ские",
+    "ого", "ему", "ыми", "его", "ому",
+    "ать", "ять", "ить", "еть",
+    "ом", "ам", "ах", "ях",
+    "ой", "ей", "ый", "ий",
+    "ов", "ев", "ям",
+    "ы", "и", "е", "я", "ю", "ь",
+    nullptr
+};
+
+std::vector<std::string_view> DefaultEndings() {
+    std::vector<std::string_view> endings;
+    for (int i = 0; kEndings[i] != nullptr; ++i) endings.push_back(kEndings[i]);
+    return endings;
+}
+
+std::atomic<const Stemmer *> g_stemmer{nullptr};
+}
+
+SuffixStemmer::SuffixStemmer(const std::vector<std::string_view> &endings, size_t min_word, size_t min_stem)
+    : min_word_(min_word), min_stem_(min_stem) {
+    // Build with ordered maps first, then flatten each node's children into edges_
+    std::vector<std::map<unsigned char, uint32_t>> children(1);
+    std::vector<bool> terminal(1, false);
+    for (std::string_view ending : endings) {
+        uint32_t node = 0;
+        for (size_t i = ending.size(); i-- > 0;) {
+            unsigned char c = static_cast<unsigned char>(ending[i]);
+            auto it = children[node].find(c);
+            if (it == children[node].end()) {
+                it = children[node].emplace(c, static_cast<uint32_t>(children.size())).first;
+                children.emplace_back();
+                terminal.push_back(false);
+            }
+            node = it->second;
         }
+        terminal[node] = true;
+    }
+
+    nodes_.resize(children.size());
+    for (size_t n = 0; n < children.size(); ++n) {
+        nodes_[n].first_edge = static_cast<uint32_t>(edges_.size());
+        nodes_[n].edge_count = static_cast<uint32_t>(children[n].size());
+        nodes_[n].terminal = terminal[n];
+        for (const auto &kv : children[n]) edges_.push_back({kv.first, kv.second});
+    }
+}
+
+std::string_view SuffixStemmer::stem(std::string_view word) const {
+    if (word.size() < min_word_) return word;
+    size_t best = 0;
+    uint32_t node = 0;
+    for (size_t depth = 1; depth <= word.size(); ++depth) {
+        unsigned char c = static_cast<unsigned char>(word[word.size() - depth]);
+        const Node &cur = nodes_[node];
+        const Edge *begin = edges_.data() + cur.first_edge;
+        const Edge *end = begin + cur.edge_count;
+        const Edge *edge = std::find_if(begin, end, [c](const Edge &e) { return e.byte == c; });
+        if (edge == end) break;
+        node = edge->target;
+        if (nodes_[node].terminal && word.size() >= depth + min_stem_) best = depth;
     }
-    return word;
+    return word.substr(0, word.size() - best);
+}
+
+const Stemmer &default_stemmer() {
+    static const SuffixStemmer stemmer(DefaultEndings(), 4, 2);
+    return stemmer;
+}
+
+void set_stemmer(const Stemmer *stemmer) {
+    g_stemmer.store(stemmer, std::memory_order_release);
+}
+
+std::string_view stem_view(std::string_view word) {
+    const Stemmer *stemmer = g_stemmer.load(std::memory_order_acquire);
+    return stemmer ? stemmer->stem(word) : default_stemmer().stem(word);
+}
+
+std::string stem_word(const std::string &word) {
+    return std::string(stem_view(word));
 }
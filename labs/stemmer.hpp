@@ -1,6 +1,50 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <string_view>
+#include <vector>
 
-// Very small Russian stemmer based on suffix stripping
+// Stemming strategy; a fuller (e.g. Snowball) Russian stemmer can implement this
+// and be installed with set_stemmer()
+class Stemmer {
+public:
+    virtual ~Stemmer() = default;
+    // Returns the stem as a prefix of word (no allocation)
+    virtual std::string_view stem(std::string_view word) const = 0;
+};
+
+// Very small Russian stemmer based on suffix stripping. Endings are compiled into
+// a reversed-suffix trie, so the longest applicable ending is found in one
+// backward pass over the word.
+class SuffixStemmer : public Stemmer {
+public:
+    // Words shorter than min_word bytes are kept; a stem keeps at least min_stem bytes
+    SuffixStemmer(const std::vector<std::string_view> &endings, size_t min_word, size_t min_stem);
+    std::string_view stem(std::string_view word) const override;
+
+private:
+    struct Edge {
+        unsigned char byte;
+        uint32_t target;
+    };
+    struct Node {
+        uint32_t first_edge{0};
+        uint32_t edge_count{0};
+        bool terminal{false};
+    };
+
+    std::vector<Node> nodes_;
+    std::vector<Edge> edges_;
+    size_t min_word_;
+    size_t min_stem_;
+};
+
+// Built-in suffix stemmer used unless another one is installed
+const Stemmer &default_stemmer();
+// Installs a stemmer for all later stem_word calls; nullptr restores the default.
+// Must be called before indexing starts, the stemmer has to outlive its use.
+void set_stemmer(const Stemmer *stemmer);
+
+std::string_view stem_view(std::string_view word);
 std::string stem_word(const std::string &word);
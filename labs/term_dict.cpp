@@ -0,0 +1,199 @@
+#include "term_dict.hpp"
+#include "postings.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+std::string_view StringArena::store(std::string_view s) {
+    while (current_ < blocks_.size() && used_ + s.size() > block_sizes_[current_]) {
+        ++current_;
+        used_ = 0;
+    }
+    if (current_ == blocks_.size()) {
+        size_t size = std::max(kBlockSize, s.size());
+        blocks_.emplace_back(new char[size]);
+        block_sizes_.push_back(size);
+        reserved_ += size;
+        used_ = 0;
+    }
+    char *dst = blocks_[current_].get() + used_;
+    if (!s.empty()) std::memcpy(dst, s.data(), s.size());
+    used_ += s.size();
+    return {dst, s.size()};
+}
+
+void StringArena::reset() {
+    current_ = 0;
+    used_ = 0;
+}
+
+uint64_t TermDictionary::hash_of(std::string_view s) {
+    // FNV-1a with a final avalanche; the low 32 bits pick the slot and are kept as a tag
+    uint64_t h = 1469598103934665603ULL;
+    for (unsigned char c : s) {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 32;
+    h *= 0xd6e8feb86659fd93ULL;
+    h ^= h >> 32;
+    return h;
+}
+
+uint32_t TermDictionary::find(std::string_view term) const {
+    if (slots_.empty()) return kNoTerm;
+    uint32_t tag = static_cast<uint32_t>(hash_of(term));
+    size_t mask = slots_.size() - 1;
+    for (size_t i = tag & mask;; i = (i + 1) & mask) {
+        const Slot &slot = slots_[i];
+        if (slot.generation != generation_) return kNoTerm;
+        if (slot.hash == tag && terms_[slot.id] == term) return slot.id;
+    }
+}
+
+uint32_t TermDictionary::intern(std::string_view term) {
+    // Keep the load factor under 1/2
+    if ((terms_.size() + 1) * 2 > slots_.size()) grow();
+    uint32_t tag = static_cast<uint32_t>(hash_of(term));
+    size_t mask = slots_.size() - 1;
+    for (size_t i = tag & mask;; i = (i + 1) & mask) {
+        Slot &slot = slots_[i];
+        if (slot.generation != generation_) {
+            uint32_t id = static_cast<uint32_t>(terms_.size());
+            terms_.push_back(arena_.store(term));
+            slot = {tag, id, generation_};
+            return id;
+        }
+        if (slot.hash == tag && terms_[slot.id] == term) return slot.id;
+    }
+}
+
+void TermDictionary::grow() {
+    size_t capacity = slots_.empty() ? 64 : slots_.size() * 2;
+    std::vector<Slot> old;
+    old.swap(slots_);
+    uint32_t old_generation = generation_;
+    slots_.assign(capacity, Slot{0, 0, 0});
+    generation_ = 1;
+    size_t mask = capacity - 1;
+    for (const Slot &slot : old) {
+        if (slot.generation != old_generation) continue;
+        size_t i = slot.hash & mask;
+        while (slots_[i].generation == generation_) i = (i + 1) & mask;
+        slots_[i] = {slot.hash, slot.id, generation_};
+    }
+}
+
+void TermDictionary::clear() {
+    terms_.clear();
+    arena_.reset();
+    if (++generation_ == 0) {
+        // Generation wrapped; wipe once so stale slots cannot look live
+        std::fill(slots_.begin(), slots_.end(), Slot{0, 0, 0});
+        generation_ = 1;
+    }
+}
+
+size_t TermDictionary::memory_bytes() const {
+    return slots_.capacity() * sizeof(Slot) + terms_.capacity() * sizeof(std::string_view) + arena_.bytes_reserved();
+}
+
+namespace {
+// Length of the UTF-8 sequence led by c (1 for stray continuation bytes)
+size_t utf8_length(unsigned char c) {
+    if (c >= 0xF0) return 4;
+    if (c >= 0xE0) return 3;
+    if (c >= 0xC0) return 2;
+    return 1;
+}
+}
+
+SortedTermDict::SortedTermDict(const std::vector<std::string_view> &terms) : count_(terms.size()) {
+    blocks_.reserve((terms.size() + kBlockTerms - 1) / kBlockTerms);
+    for (size_t i = 0; i < terms.size(); ++i) {
+        std::string_view term = terms[i];
+        size_t shared = 0;
+        if (i % kBlockTerms == 0) {
+            blocks_.push_back(static_cast<uint32_t>(bytes_.size()));
+        } else {
+            std::string_view prev = terms[i - 1];
+            size_t limit = std::min(prev.size(), term.size());
+            while (shared < limit && prev[shared] == term[shared]) ++shared;
+            write_varint(bytes_, shared);
+        }
+        write_varint(bytes_, term.size() - shared);
+        bytes_.insert(bytes_.end(), term.begin() + static_cast<std::ptrdiff_t>(shared), term.end());
+    }
+    bytes_.shrink_to_fit();
+}
+
+void SortedTermDict::decode_next(const uint8_t *&p, std::string &term, bool block_start) {
+    size_t shared = block_start ? 0 : static_cast<size_t>(read_varint(p));
+    size_t suffix = static_cast<size_t>(read_varint(p));
+    term.resize(shared);
+    term.append(reinterpret_cast<const char *>(p), suffix);
+    p += suffix;
+}
+
+uint32_t SortedTermDict::lower_bound(std::string_view key) const {
+    // Last block whose first term is <= key; the answer is in it or starts the next
+    size_t lo = 0, hi = blocks_.size();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const uint8_t *p = bytes_.data() + blocks_[mid];
+        size_t len = static_cast<size_t>(read_varint(p));
+        if (std::string_view(reinterpret_cast<const char *>(p), len) <= key) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == 0) return 0;
+    uint32_t found = static_cast<uint32_t>(count_);
+    scan(static_cast<uint32_t>((lo - 1) * kBlockTerms), [&](uint32_t rank, std::string_view term) {
+        if (term < key) return true;
+        found = rank;
+        return false;
+    });
+    return found;
+}
+
+std::string SortedTermDict::term(uint32_t rank) const {
+    std::string out;
+    scan(rank, [&](uint32_t, std::string_view term) {
+        out.assign(term.data(), term.size());
+        return false;
+    });
+    return out;
+}
+
+bool is_term_pattern(std::string_view s) {
+    return s.find_first_of("*?") != std::string_view::npos;
+}
+
+std::string_view pattern_prefix(std::string_view pattern) {
+    return pattern.substr(0, std::min(pattern.size(), pattern.find_first_of("*?")));
+}
+
+// Greedy glob match; on a mismatch the last '*' absorbs one more character
+bool match_term_pattern(std::string_view pattern, std::string_view term) {
+    size_t p = 0, t = 0;
+    size_t star = std::string_view::npos, star_t = 0;
+    while (t < term.size()) {
+        if (p < pattern.size() && pattern[p] == '*') {
+            star = ++p;
+            star_t = t;
+        } else if (p < pattern.size() && pattern[p] == '?') {
+            ++p;
+            t += utf8_length(static_cast<unsigned char>(term[t]));
+        } else if (p < pattern.size() && pattern[p] == term[t]) {
+            ++p;
+            ++t;
+        } else if (star != std::string_view::npos) {
+            p = star;
+            star_t += utf8_length(static_cast<unsigned char>(term[star_t]));
+            t = star_t;
+        } else {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == '*') ++p;
+    return p == pattern.size() && t == term.size();
+}
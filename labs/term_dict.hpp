@@ -0,0 +1,106 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Bump allocator for strings; views stay valid until reset()
+class StringArena {
+public:
+    std::string_view store(std::string_view s);
+    // Forgets every string but keeps the blocks for reuse
+    void reset();
+    size_t bytes_reserved() const { return reserved_; }
+
+private:
+    static constexpr size_t kBlockSize = 64 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    std::vector<size_t> block_sizes_;
+    size_t current_{0};
+    size_t used_{0};
+    size_t reserved_{0};
+};
+
+// Interns strings to dense ids 0..size()-1 using an open-addressing table
+// (linear probing, load <= 1/2) over arena-backed string_views.
+// Capacity is limited to 2^32 slots.
+class TermDictionary {
+public:
+    static constexpr uint32_t kNoTerm = UINT32_MAX;
+
+    uint32_t intern(std::string_view term);
+    uint32_t find(std::string_view term) const;
+    std::string_view term(uint32_t id) const { return terms_[id]; }
+    size_t size() const { return terms_.size(); }
+    bool empty() const { return terms_.empty(); }
+    // O(1): slots are invalidated by bumping the generation
+    void clear();
+    size_t memory_bytes() const;
+
+private:
+    struct Slot {
+        uint32_t hash;
+        uint32_t id;
+        uint32_t generation;
+    };
+
+    static uint64_t hash_of(std::string_view s);
+    void grow();
+
+    std::vector<Slot> slots_;
+    std::vector<std::string_view> terms_;
+    StringArena arena_;
+    uint32_t generation_{1};
+};
+
+// Immutable byte-ordered term list, front coded: the first term of every block
+// of kBlockTerms is stored whole, the others as (shared prefix length, suffix).
+// Ranks are positions in byte order.
+class SortedTermDict {
+public:
+    static constexpr size_t kBlockTerms = 16;
+
+    SortedTermDict() = default;
+    // terms must be sorted and distinct
+    explicit SortedTermDict(const std::vector<std::string_view> &terms);
+
+    size_t size() const { return count_; }
+    size_t memory_bytes() const { return bytes_.capacity() + blocks_.capacity() * sizeof(uint32_t); }
+    // Rank of the first term >= key, size() if there is none
+    uint32_t lower_bound(std::string_view key) const;
+    std::string term(uint32_t rank) const;
+
+    // Calls visit(rank, term) in byte order from rank `from` until it returns false
+    template <typename Visit>
+    void scan(uint32_t from, Visit visit) const {
+        std::string term;
+        for (size_t block = from / kBlockTerms; block < blocks_.size(); ++block) {
+            const uint8_t *p = bytes_.data() + blocks_[block];
+            uint32_t rank = static_cast<uint32_t>(block * kBlockTerms);
+            uint32_t end = static_cast<uint32_t>(std::min(count_, rank + kBlockTerms));
+            for (; rank < end; ++rank) {
+                decode_next(p, term, rank % kBlockTerms == 0);
+                if (rank >= from && !visit(rank, std::string_view(term))) return;
+            }
+        }
+    }
+
+private:
+    std::vector<uint8_t> bytes_;
+    std::vector<uint32_t> blocks_;  // byte offset of each block
+    size_t count_{0};
+
+    // Replaces term with the next encoded term; the first of a block shares nothing
+    static void decode_next(const uint8_t *&p, std::string &term, bool block_start);
+};
+
+// Term patterns of prefix and wildcard queries: '*' matches any run of
+// characters, '?' exactly one UTF-8 code point
+bool is_term_pattern(std::string_view s);
+// Literal part before the first wildcard
+std::string_view pattern_prefix(std::string_view pattern);
+bool match_term_pattern(std::string_view pattern, std::string_view term);
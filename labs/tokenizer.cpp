@@ -1,10 +1,16 @@
 #include "tokenizer.hpp"
+#include "metrics.hpp"
+#include "stemmer.hpp"
 
 #include <algorithm>
 #include <cctype>
 #include <cstring>
 #include <unordered_set>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 namespace {
 const char *kStopwords[] = {
     "в", "и", "на", "с", "по", "для", "от", "к", "как", "это",
@@ -21,10 +27,64 @@ const char *kStopwords[] = {
     nullptr
 };
 
+// Code point classes: kDelim splits tokens, kIgnore is dropped without splitting
+// (combining accents, soft hyphen, joiners), anything else is the folded code point.
+constexpr uint32_t kDelim = 0;
+constexpr uint32_t kIgnore = 0xFFFFFFFF;
+
+uint32_t fold_pair(uint32_t cp, bool upper_is_even) {
+    return ((cp & 1) == 0) == upper_is_even ? cp + 1 : cp;
+}
+
+uint32_t classify_slow(uint32_t cp) {
+    if (cp < 0x80) {
+        if ((cp >= 'a' && cp <= 'z') || (cp >= '0' && cp <= '9') || cp == '-') return cp;
+        if (cp >= 'A' && cp <= 'Z') return cp + 32;
+        return kDelim;
+    }
+    if (cp == 0xAD) return kIgnore;                       // soft hyphen
+    if (cp < 0xC0) return kDelim;                         // nbsp, « », ©, ° ...
+    if (cp == 0xD7 || cp == 0xF7) return kDelim;          // × ÷
+    if (cp <= 0xDE) return cp + 0x20;                     // À-Þ
+    if (cp <= 0xFF) return cp;
+    if (cp <= 0x137 || (cp >= 0x14A && cp <= 0x177)) return fold_pair(cp, true);
+    if ((cp >= 0x139 && cp <= 0x148) || (cp >= 0x179 && cp <= 0x17E)) return fold_pair(cp, false);
+    if (cp <= 0x2AF) return cp;
+    if (cp <= 0x2FF) return kDelim;                       // spacing modifiers
+    if (cp <= 0x36F) return kIgnore;                      // combining diacritics, e.g. stress marks
+    if (cp >= 0x391 && cp <= 0x3A9) return cp + 0x20;     // Greek capitals
+    if (cp == 0x37E || cp == 0x387) return kDelim;
+    if (cp <= 0x3FF) return cp;
+    if (cp == 0x401 || cp == 0x451) return 0x435;         // Ё ё -> е
+    if (cp <= 0x40F) return cp + 0x50;                    // Ѐ-Џ
+    if (cp <= 0x42F) return cp + 0x20;                    // А-Я
+    if (cp <= 0x45F) return cp;
+    if (cp <= 0x481) return fold_pair(cp, true);
+    if (cp == 0x482) return kDelim;                       // ҂
+    if (cp <= 0x489) return kIgnore;                      // Cyrillic combining marks
+    if (cp <= 0x4BF) return fold_pair(cp, true);
+    if (cp == 0x4C0) return 0x4CF;
+    if (cp <= 0x4CE) return fold_pair(cp, false);
+    if (cp <= 0x52F) return fold_pair(cp, true);
+    if (cp == 0x200C || cp == 0x200D || cp == 0x2060 || cp == 0xFEFF) return kIgnore;
+    if (cp >= 0xFE00 && cp <= 0xFE0F) return kIgnore;     // variation selectors
+    if (cp >= 0x2000 && cp <= 0x2BFF) return kDelim;      // punctuation, №, currency, arrows, math
+    if (cp >= 0x2E00 && cp <= 0x2E7F) return kDelim;
+    if (cp >= 0x3000 && cp <= 0x303F) return kDelim;
+    if (cp >= 0xE000 && cp <= 0xF8FF) return kDelim;      // private use
+    if (cp >= 0xFE30 && cp <= 0xFE6F) return kDelim;
+    if (cp >= 0xFF00 && cp <= 0xFF0F) return kDelim;
+    if ((cp >= 0xFF1A && cp <= 0xFF20) || (cp >= 0xFF3B && cp <= 0xFF40) || (cp >= 0xFF5B && cp <= 0xFF65)) return kDelim;
+    if (cp >= 0xFFF0 && cp <= 0xFFFF) return kDelim;
+    if (cp >= 0x1F000 && cp <= 0x1FAFF) return kDelim;    // emoji and pictographs
+    return cp;
+}
+
+// Stopwords are folded like tokens ("её" -> "ее")
 std::unordered_set<std::string> BuildStopwordSet() {
     std::unordered_set<std::string> s;
     for (int i = 0; kStopwords[i] != nullptr; ++i) {
-        s.insert(kStopwords[i]);
+        s.insert(fold_token(kStopwords[i]));
     }
     return s;
 }
@@ -34,19 +94,189 @@ const std::unordered_set<std::string> &Stopwords() {
     return stop;
 }
 
-char to_lower_ascii(char c) {
-    if (c >= 'A' && c <= 'Z') return static_cast<char>(c + 32);
-    return static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+// Precomputed classes for the one- and two-byte range (ASCII, Latin, Greek, Cyrillic)
+struct FoldTable {
+    uint32_t cls[0x800];
+    FoldTable() {
+        for (uint32_t cp = 0; cp < 0x800; ++cp) cls[cp] = classify_slow(cp);
+    }
+};
+
+uint32_t classify(uint32_t cp) {
+    static const FoldTable table;
+    return cp < 0x800 ? table.cls[cp] : classify_slow(cp);
+}
+
+void append_utf8(std::string &out, uint32_t cp) {
+    if (cp < 0x80) {
+        out.push_back(static_cast<char>(cp));
+    } else if (cp < 0x800) {
+        out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000) {
+        out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else {
+        out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    }
+}
+
+// Sequence length by lead byte; 0 marks continuation bytes and invalid leads
+const uint8_t kUtf8Length[256] = {
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+// Scanners over [i, n): the SSE2 path classifies 16 bytes per step, the tail is scalar.
+#if defined(__SSE2__)
+inline uint32_t ascii_token_mask(__m128i v) {
+    __m128i folded = _mm_or_si128(v, _mm_set1_epi8(0x20)); // A-Z -> a-z, leaves digits and '-' alone
+    __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(folded, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(folded, _mm_set1_epi8('z' + 1)));
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+    __m128i dash = _mm_cmpeq_epi8(v, _mm_set1_epi8('-'));
+    return static_cast<uint32_t>(_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(alpha, digit), dash)));
+}
+#endif
+
+inline bool is_ascii_token(unsigned char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-';
+}
+
+// Skips ASCII delimiters: first byte that is an ASCII token char, '<' or non-ASCII
+size_t skip_ascii_delims(const char *p, size_t i, size_t n) {
+#if defined(__SSE2__)
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+        uint32_t hits = ascii_token_mask(v) | static_cast<uint32_t>(_mm_movemask_epi8(v)) |
+                        static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('<'))));
+        if (hits) return i + __builtin_ctz(hits);
+    }
+#endif
+    while (i < n) {
+        unsigned char c = static_cast<unsigned char>(p[i]);
+        if (c >= 0x80 || c == '<' || is_ascii_token(c)) break;
+        ++i;
+    }
+    return i;
+}
+
+// End of a run of ASCII token chars
+size_t ascii_token_end(const char *p, size_t i, size_t n) {
+#if defined(__SSE2__)
+    for (; i + 16 <= n; i += 16) {
+        uint32_t stops = ~ascii_token_mask(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i))) & 0xFFFF;
+        if (stops) return i + __builtin_ctz(stops);
+    }
+#endif
+    while (i < n && is_ascii_token(static_cast<unsigned char>(p[i]))) ++i;
+    return i;
+}
+
+// p[i] == '<'; returns the index after the closing '>' (or n for an unterminated tag)
+size_t skip_tag(const char *p, size_t i, size_t n) {
+    const char *close = static_cast<const char *>(std::memchr(p + i + 1, '>', n - i - 1));
+    return close ? static_cast<size_t>(close - p) + 1 : n;
+}
+
+void append_lower_ascii(std::string &out, const char *p, size_t len) {
+    size_t start = out.size();
+    out.append(p, len);
+    for (size_t k = start; k < out.size(); ++k) {
+        if (out[k] >= 'A' && out[k] <= 'Z') out[k] = static_cast<char>(out[k] + 32);
+    }
+}
+}
+
+size_t decode_utf8(const char *p, size_t n, uint32_t &cp) {
+    unsigned char c = static_cast<unsigned char>(p[0]);
+    size_t len = kUtf8Length[c];
+    if (len == 1) {
+        cp = c;
+        return 1;
+    }
+    if (len == 0 || len > n) return 0;
+    cp = c & (0x7F >> len);
+    for (size_t k = 1; k < len; ++k) {
+        unsigned char cc = static_cast<unsigned char>(p[k]);
+        if ((cc & 0xC0) != 0x80) return 0;
+        cp = (cp << 6) | (cc & 0x3F);
+    }
+    return len;
 }
+
+size_t scan_code_point(std::string_view s, size_t i, bool &delim) {
+    unsigned char c = static_cast<unsigned char>(s[i]);
+    if (c < 0x80) {
+        delim = !is_ascii_token(c);
+        return 1;
+    }
+    uint32_t cp = 0;
+    size_t len = decode_utf8(s.data() + i, s.size() - i, cp);
+    delim = len == 0 || classify(cp) == kDelim;
+    return len ? len : 1;
 }
 
 bool is_token_char(unsigned char c) {
-    if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '-') return true;
-    if (c >= 0x80) return true;
-    return false;
+    return is_ascii_token(c) || c >= 0x80;
 }
 
-std::string strip_tags(const std::string &html) {
+std::string fold_token(std::string_view s) {
+    std::string out;
+    out.reserve(s.size());
+    size_t i = 0;
+    while (i < s.size()) {
+        uint32_t cp = 0;
+        size_t len = decode_utf8(s.data() + i, s.size() - i, cp);
+        if (len == 0) {
+            ++i;
+            continue;
+        }
+        i += len;
+        uint32_t folded = classify(cp);
+        if (folded != kDelim && folded != kIgnore) append_utf8(out, folded);
+    }
+    return out;
+}
+
+std::vector<std::string> split_token(std::string_view s, std::string_view keep) {
+    std::vector<std::string> pieces(1);
+    auto split = [&pieces]() {
+        if (!pieces.back().empty()) pieces.emplace_back();
+    };
+    size_t i = 0;
+    while (i < s.size()) {
+        if (keep.find(s[i]) != std::string_view::npos) {
+            pieces.back() += s[i++];
+            continue;
+        }
+        uint32_t cp = 0;
+        size_t len = decode_utf8(s.data() + i, s.size() - i, cp);
+        if (len == 0) {
+            split();
+            ++i;
+            continue;
+        }
+        i += len;
+        uint32_t folded = classify(cp);
+        if (folded == kDelim) split();
+        else if (folded != kIgnore) append_utf8(pieces.back(), folded);
+    }
+    if (pieces.back().empty()) pieces.pop_back();
+    return pieces;
+}
+
+std::string strip_tags(std::string_view html) {
+    StageTimer timer(Stage::StripTags);
     std::string out;
     out.reserve(html.size());
     bool in_tag = false;
@@ -64,32 +294,80 @@ std::string strip_tags(const std::string &html) {
     return out;
 }
 
-void tokenize_document(const Document &doc, std::unordered_map<std::string, uint32_t> &freqs, TokenizationStats &stats) {
-    std::string text = strip_tags(doc.text);
-    stats.docs += 1;
-    stats.bytes_in += text.size();
+void tokenize_document(const Document &doc, TermCounter &counter, TokenizationStats &stats) {
+    tokenize_document(doc.text, counter, stats);
+}
+
+// Tags are skipped and tokens split in one sweep over the raw HTML. ASCII runs are
+// classified 16 bytes at a time; other bytes are decoded as UTF-8 and folded
+// through classify(). A tag does not end a token ("при<b>вет" is one token,
+// as with strip_tags). Tokens are built in one reused buffer.
+void tokenize_document(std::string_view html, TermCounter &counter, TokenizationStats &stats) {
+    StageTimer timer(Stage::Tokenize);
+    uint64_t tokens_before = stats.tokens;
+    const char *p = html.data();
+    const size_t n = html.size();
+    size_t tag_bytes = 0;
 
     std::string token;
-    token.reserve(32);
+    token.reserve(64);
+    uint32_t position = 0;
 
     auto flush = [&]() {
         if (token.empty()) return;
-        if (!token.empty()) {
-            if (Stopwords().find(token) == Stopwords().end()) {
-                ++freqs[token];
-                stats.tokens += 1;
-                stats.token_chars += token.size();
-            }
+        if (Stopwords().find(token) == Stopwords().end()) {
+            counter.add(token, position);
+            stats.tokens += 1;
+            stats.token_chars += token.size();
         }
+        ++position;
         token.clear();
     };
 
-    for (unsigned char c : text) {
-        if (is_token_char(c)) {
-            token.push_back(to_lower_ascii(static_cast<char>(c)));
+    size_t i = 0;
+    while (i < n) {
+        unsigned char c = static_cast<unsigned char>(p[i]);
+        if (c == '<') {
+            size_t next = skip_tag(p, i, n);
+            tag_bytes += next - i;
+            i = next;
+        } else if (c < 0x80) {
+            if (is_ascii_token(c)) {
+                size_t end = ascii_token_end(p, i, n);
+                append_lower_ascii(token, p + i, end - i);
+                i = end;
+            } else {
+                flush();
+                i = skip_ascii_delims(p, i + 1, n);
+            }
         } else {
-            flush();
+            uint32_t cp = 0;
+            size_t len = decode_utf8(p + i, n - i, cp);
+            if (len == 0) {
+                flush();
+                ++i;
+                continue;
+            }
+            i += len;
+            uint32_t folded = classify(cp);
+            if (folded == kDelim) flush();
+            else if (folded != kIgnore) append_utf8(token, folded);
         }
     }
     flush();
+
+    stats.docs += 1;
+    stats.bytes_in += n - tag_bytes;
+    add_counter(Counter::Documents);
+    add_counter(Counter::Tokens, stats.tokens - tokens_before);
+}
+
+bool is_stopword(std::string_view token) {
+    return Stopwords().count(std::string(token)) != 0;
+}
+
+std::string normalize_term(const std::string &s) {
+    std::string term = fold_token(s);
+    term.resize(stem_view(term).size());
+    return term;
 }
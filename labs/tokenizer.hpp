@@ -1,8 +1,11 @@
 #pragma once
 
+#include "term_dict.hpp"
+
 #include <cstdint>
+#include <functional>
 #include <string>
-#include <unordered_map>
+#include <string_view>
 #include <vector>
 
 struct Document {
@@ -13,6 +16,18 @@ struct Document {
     std::string text;
 };
 
+// Same fields as Document, borrowed from the input buffer (see NdjsonScanner)
+struct DocumentView {
+    uint64_t id{0};
+    std::string_view source;
+    std::string_view url;
+    std::string_view title;
+    std::string_view text;
+};
+
+// Copies the id, source, url and title of a build's i-th doc into meta
+using DocMetadata = std::function<void(size_t i, Document &meta)>;
+
 struct TokenizationStats {
     uint64_t docs{0};
     uint64_t tokens{0};
@@ -20,6 +35,64 @@ struct TokenizationStats {
     uint64_t bytes_in{0};
 };
 
+// Byte-level prefilter: ASCII letters, digits, '-' and every non-ASCII byte
+// (non-ASCII code points are then decoded and classified, see fold_token)
 bool is_token_char(unsigned char c);
-std::string strip_tags(const std::string &html);
-void tokenize_document(const Document &doc, std::unordered_map<std::string, uint32_t> &freqs, TokenizationStats &stats);
+
+// Per-document token frequencies keyed by dense local ids. Meant to be reused:
+// clear() keeps the table, arena and count buffer allocated.
+// With record_positions on, the token positions of every term are kept too.
+class TermCounter {
+public:
+    void set_record_positions(bool on) { record_positions_ = on; }
+    bool record_positions() const { return record_positions_; }
+
+    void clear() {
+        dict_.clear();
+        for (size_t i = 0; i < counts_.size() && i < positions_.size(); ++i) positions_[i].clear();
+        counts_.clear();
+    }
+    void add(std::string_view token, uint32_t position) {
+        uint32_t id = dict_.intern(token);
+        if (id == counts_.size()) counts_.push_back(0);
+        ++counts_[id];
+        if (record_positions_) {
+            if (id >= positions_.size()) positions_.resize(id + 1);
+            positions_[id].push_back(position);
+        }
+    }
+
+    size_t size() const { return counts_.size(); }
+    std::string_view term(uint32_t id) const { return dict_.term(id); }
+    uint32_t count(uint32_t id) const { return counts_[id]; }
+    // Ascending; empty unless record_positions is on
+    const std::vector<uint32_t> &positions(uint32_t id) const { return positions_[id]; }
+
+private:
+    TermDictionary dict_;
+    std::vector<uint32_t> counts_;
+    std::vector<std::vector<uint32_t>> positions_;
+    bool record_positions_{false};
+};
+// Decodes one UTF-8 sequence; returns its length, 0 for an invalid sequence
+size_t decode_utf8(const char *p, size_t n, uint32_t &cp);
+// Byte length of the code point at s[i] (1 for an invalid byte); delim is set
+// when tokenize_document would end a token there
+size_t scan_code_point(std::string_view s, size_t i, bool &delim);
+// Lowercases ASCII/Latin/Greek/Cyrillic, maps ё to е and drops punctuation and
+// combining marks; the same folding tokenize_document applies to every token
+std::string fold_token(std::string_view s);
+// Folds s like fold_token but splits it wherever tokenize_document would end a
+// token, so "москва—сити" gives two pieces. Chars in keep are copied as they are.
+std::vector<std::string> split_token(std::string_view s, std::string_view keep = {});
+std::string strip_tags(std::string_view html);
+// Adds the folded, non-stopword tokens of text to counter (which is not cleared).
+// Positions count every token, stopwords included, starting at 0.
+void tokenize_document(std::string_view text, TermCounter &counter, TokenizationStats &stats);
+void tokenize_document(const Document &doc, TermCounter &counter, TokenizationStats &stats);
+
+// token must already be folded
+bool is_stopword(std::string_view token);
+
+// Folds and stems a raw token; shared by indexing and query parsing
+std::string normalize_term(const std::string &s);
@@ -1,40 +1,51 @@
 #include "zipf.hpp"
+#include "buffered_writer.hpp"
 
-#include <algorithm>
 #include <cmath>
-#include <fstream>
+
+namespace {
+ZipfRow zipf_row(uint64_t rank, const RankedTerm &t, uint64_t top_freq) {
+    double r = static_cast<double>(rank);
+    double expected = static_cast<double>(top_freq) / r;
+    return {rank, std::string(t.term), t.cf,
+            std::log10(r), std::log10(static_cast<double>(t.cf)),
+            expected, std::log10(expected)};
+}
+}
 
 std::vector<ZipfRow> build_zipf_rows(const InvertedIndex &index) {
-    std::vector<std::pair<std::string, TokenInfo>> items(index.tokens().begin(), index.tokens().end());
-    std::sort(items.begin(), items.end(), [](const auto &a, const auto &b) {
-        if (a.second.cf != b.second.cf) return a.second.cf > b.second.cf;
-        return a.first < b.first;
-    });
+    return build_zipf_rows(rank_terms(index));
+}
 
+std::vector<ZipfRow> build_zipf_rows(const std::vector<RankedTerm> &ranked) {
     std::vector<ZipfRow> rows;
-    rows.reserve(items.size());
-    if (items.empty()) return rows;
-
-    double top_freq = static_cast<double>(items.front().second.cf);
-    uint64_t rank = 0;
-    for (const auto &kv : items) {
-        ++rank;
-        double r = static_cast<double>(rank);
-        double freq = static_cast<double>(kv.second.cf);
-        double expected = top_freq / r;
-        rows.push_back({rank, kv.first, kv.second.cf,
-                        std::log10(r), std::log10(freq),
-                        expected, std::log10(expected)});
-    }
+    rows.reserve(ranked.size());
+    for (size_t i = 0; i < ranked.size(); ++i) rows.push_back(zipf_row(i + 1, ranked[i], ranked.front().cf));
     return rows;
 }
 
-void save_zipf_tsv(const std::string &path, const std::vector<ZipfRow> &rows) {
-    std::ofstream out(path);
-    out << "rank\ttoken\tfreq\tlog_rank\tlog_freq\tzipf_expected\tlog_zipf_expected\n";
-    for (const auto &row : rows) {
-        out << row.rank << '\t' << row.token << '\t' << row.freq << '\t'
-            << row.log_rank << '\t' << row.log_freq << '\t'
-            << row.zipf_expected << '\t' << row.log_zipf_expected << '\n';
+bool write_zipf_tsv(const std::string &path, const std::vector<RankedTerm> &ranked) {
+    BufferedWriter out;
+    if (!out.open(path)) return false;
+    out.put("rank\ttoken\tfreq\tlog_rank\tlog_freq\tzipf_expected\tlog_zipf_expected\n");
+    for (size_t i = 0; i < ranked.size(); ++i) {
+        const RankedTerm &t = ranked[i];
+        double r = static_cast<double>(i + 1);
+        double expected = static_cast<double>(ranked.front().cf) / r;
+        out.put_uint(i + 1);
+        out.put('\t');
+        out.put(t.term);
+        out.put('\t');
+        out.put_uint(t.cf);
+        out.put('\t');
+        out.put_double(std::log10(r));
+        out.put('\t');
+        out.put_double(std::log10(static_cast<double>(t.cf)));
+        out.put('\t');
+        out.put_double(expected);
+        out.put('\t');
+        out.put_double(std::log10(expected));
+        out.put('\n');
     }
+    return out.close();
 }
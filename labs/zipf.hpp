@@ -1,5 +1,6 @@
 #pragma once
 
+#include "export.hpp"
 #include "index.hpp"
 
 #include <string>
@@ -16,4 +17,7 @@ struct ZipfRow {
 };
 
 std::vector<ZipfRow> build_zipf_rows(const InvertedIndex &index);
-void save_zipf_tsv(const std::string &path, const std::vector<ZipfRow> &rows);
+// ranked as returned by rank_terms
+std::vector<ZipfRow> build_zipf_rows(const std::vector<RankedTerm> &ranked);
+// Streams the rows of ranked without building them all first
+bool write_zipf_tsv(const std::string &path, const std::vector<RankedTerm> &ranked);